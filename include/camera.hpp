@@ -6,53 +6,210 @@
 #include "straw.hpp"
 
 #include <vector>
+#include <span>
+#include <array>
+#include <unordered_map>
+#include <cstdint>
+#include <limits>
 #include <concepts>
 #include <algorithm>
 
-class Camera;
-struct RenderBatchEntry {
-    shapes::shapes_variant<long> shape;
+/*Look shared by batched shapes. Lower layers are drawn first*/
+struct RenderStyle {
     straw::color fg, bg;
     char c;
+    int layer;
 
-    template<class T>
-    constexpr RenderBatchEntry(T Shape) : shape(Shape), fg(straw::WHITE), bg(straw::BLACK), c('#') {}
-    template<class T>
-    constexpr RenderBatchEntry(T Shape, char C) : shape(Shape), fg(straw::WHITE), bg(straw::BLACK), c(C) {}
-    template<class T>
-    constexpr RenderBatchEntry(T Shape, straw::color Fg, char C) : shape(Shape), fg(Fg), bg(straw::BLACK), c(C) {}
-    template<class T>
-    constexpr RenderBatchEntry(T Shape, straw::color Fg, straw::color Bg, char C) : shape(Shape), fg(Fg), bg(Bg), c(C) {}
-
-    void translate(Camera *camera);
-    void plot(Camera *camera);
-private:
-    void plotPoint(shapes::point<long> point, Camera *camera);
-    void plotLine(shapes::line<long> line, Camera *camera);
-    void plotRectangle(shapes::rectangle<long> rectangle, Camera *camera);
-    void plotCircle(shapes::circle<long> circle, Camera *camera);
-    void plotEllipse(shapes::ellipse<long> ellipse, Camera *camera);
+    straw::cell<char> cell() const { return straw::cell<char>(c, bg, fg); }
 };
 
 class Camera
 {
-    friend struct RenderBatchEntry;
+public:
+    static constexpr std::uint32_t NO_PICK = std::numeric_limits<std::uint32_t>::max();
+    //Layers run from 0 to this, higher ones drawn over lower ones
+    static constexpr int MAX_LAYER = 255;
+private:
+    enum ShapeKind : unsigned char { POINT, LINE, CIRCLE, ELLIPSE, RECTANGLE, SHAPE_KINDS };
+
+    /*Batched shapes of one kind, one array per coordinate. x and y are the
+     * position, u and v the end of a line or the extents of anything else*/
+    struct ShapeArrays {
+        std::vector<long> x, y, u, v;
+        std::vector<std::uint32_t> style, pick;
+
+        std::size_t size() const { return x.size(); }
+        void push(long X, long Y, long U, long V, std::uint32_t Style, std::uint32_t Pick) {
+            x.push_back(X); y.push_back(Y); u.push_back(U); v.push_back(V);
+            style.push_back(Style); pick.push_back(Pick);
+        }
+        void clear() { x.clear(); y.clear(); u.clear(); v.clear(); style.clear(); pick.clear(); }
+    };
+
+    /*World to screen mapping, fixed for a frame. Zooming keeps the scale a
+     * power of two, which turns the division into a shift. Inputs are clamped
+     * so the offset cannot overflow, and results saturate so far away
+     * coordinates stay far away instead of wrapping*/
+    struct ScreenTransform {
+        static constexpr long WORLD_LIMIT = 1L << 61;
+
+        long offx = 0, offy = 0;
+        long scale = 1;
+        int shift = 0; /*-1 when scale is not a power of two*/
+
+        long floordiv(long v) const {
+            long q = v / scale;
+            return (v % scale != 0 && v < 0) ? q - 1 : q;
+        }
+        static long world(long p) { return std::clamp(p, -WORLD_LIMIT, WORLD_LIMIT); }
+    };
+    //Line endpoints keep their full range for clipping, other shapes stay well inside int
+    static constexpr long LINE_LIMIT = 1L << 60;
+    static constexpr long SHAPE_LIMIT = 1L << 30;
+
+    struct DrawItem {
+        std::uint32_t index;
+        ShapeKind kind;
+    };
+
+    /*Cells the camera draws into, and the pick id of whatever shows in each.
+     * Shapes are drawn front to back, so the first write to a cell in a pass
+     * is the one that stays. written holds the pass that last wrote a cell,
+     * which saves clearing it, filled counts the cells each row has had
+     * written this pass, and solid is the widest run of written cells known
+     * in each row. Nothing is shared between rows, so threads can fill
+     * different rows at once*/
+    /*Columns [x0, x1) of a raster row*/
+    struct Span {
+        unsigned x0, x1;
+    };
+
+    struct Raster {
+        unsigned width, height;
+        std::vector<straw::cell<char>> cells;
+        std::vector<std::uint32_t> picks;
+        std::vector<std::uint32_t> written;
+        std::vector<unsigned> filled;
+        std::vector<Span> solid;
+        std::uint32_t pass;
+
+        Raster(unsigned w, unsigned h) :
+            width(w), height(h), cells((std::size_t)w * h, straw::cell<char>(' ')), picks((std::size_t)w * h, NO_PICK),
+            written((std::size_t)w * h, 0), filled(h, 0), solid(h, Span{0, 0}), pass(0) {}
+        const straw::cell<char> *row(unsigned y) const { return cells.data() + ((std::size_t)y * width); }
+        std::uint32_t pick(unsigned x, unsigned y) const { return picks[((std::size_t)y * width) + x]; }
+
+        void begin() {
+            if(++pass == 0) {
+                std::fill(written.begin(), written.end(), 0);
+                pass = 1;
+            }
+            std::fill(filled.begin(), filled.end(), 0);
+            std::fill(solid.begin(), solid.end(), Span{0, 0});
+        }
+        //True when every cell of [x0, x1) in the row was written this pass
+        bool covers(unsigned y, unsigned x0, unsigned x1) const {
+            return filled[y] >= width || (solid[y].x0 <= x0 && x1 <= solid[y].x1);
+        }
+        //Takes in a run of written cells, joining it to the row's run when they touch
+        void extend(unsigned y, unsigned x0, unsigned x1) {
+            Span &s = solid[y];
+            if(x0 <= s.x1 && x1 >= s.x0) s = Span{std::min(s.x0, x0), std::max(s.x1, x1)};
+            else if(x1 - x0 > s.x1 - s.x0) s = Span{x0, x1};
+        }
+        //Writes c unless something in front already took the cell this pass
+        void set(unsigned x, unsigned y, const straw::cell<char> &c, std::uint32_t pick) {
+            std::size_t at = ((std::size_t)y * width) + x;
+            if(written[at] == pass) return;
+            written[at] = pass;
+            cells[at] = c;
+            picks[at] = pick;
+            filled[y]++;
+            extend(y, x, x + 1);
+        }
+        void fill(unsigned y, unsigned x0, unsigned x1, const straw::cell<char> &c, std::uint32_t pick) {
+            if(covers(y, x0, x1)) return;
+            for(unsigned x = x0; x < x1; x++) set(x, y, c, pick);
+            extend(y, x0, x1);
+        }
+        void blank(unsigned y, unsigned x0, unsigned x1, const straw::cell<char> &c) {
+            std::size_t at = (std::size_t)y * width;
+            std::fill(cells.begin() + at + x0, cells.begin() + at + x1, c);
+            std::fill(picks.begin() + at + x0, picks.begin() + at + x1, NO_PICK);
+        }
+        void clear(const straw::cell<char> &c) {
+            std::fill(cells.begin(), cells.end(), c);
+            std::fill(picks.begin(), picks.end(), NO_PICK);
+        }
+        void shift(int dx, int dy, const straw::cell<char> &c);
+    };
+
+    /*A band of raster rows and the shapes that reach it, drawn by one thread*/
+    struct Tile {
+        straw::region clip; /*Rows of the band within the pass's clip, in unflipped screen space*/
+        std::vector<DrawItem> items;
+    };
+    //Bands are kept at least this tall, and a few per thread so uneven ones even out
+    static constexpr unsigned TILE_MIN_ROWS = 8;
+    static constexpr unsigned TILES_PER_THREAD = 2;
 
     vex::vec2<long> m_position;
     vex::vec2<long> m_origin;
     shapes::rectangle<long> m_frustum;
+    ScreenTransform m_transform;
+    ScreenTransform m_drawn; /*Transform of the frame in m_raster*/
 
-    std::vector<RenderBatchEntry> m_shapeBatch;
+    std::array<ShapeArrays, SHAPE_KINDS> m_batches;
+    std::vector<RenderStyle> m_styles;
+    std::unordered_map<std::uint64_t, std::uint32_t> m_styleIndex;
+    std::vector<std::uint8_t> m_visible;
+    std::vector<DrawItem> m_drawList;
+    std::vector<DrawItem> m_drawOrder;
+    std::vector<std::uint32_t> m_styleRank; /*Style ids by layer*/
+    std::vector<std::size_t> m_styleStart;  /*Scratch for the counting sort*/
+    std::vector<Tile> m_tiles;
 
     long m_scale;
     bool m_dirty;
+    bool m_repaint; /*Set by anything but a pan, which can reuse the last frame*/
 
     straw::screen<char> *m_viewport;
+    Raster m_raster;      /*What the camera drew, without the text written over the viewport*/
+    straw::region m_clip; /*Cells this pass may write to, in unflipped screen space*/
+
+    //The frame's plan, either a full repaint or a shift of m_raster plus the strips it uncovers
+    bool m_reuse;
+    int m_shiftX, m_shiftY;
+    std::array<straw::region, 2> m_clips;
+    std::array<shapes::rectangle<long>, 2> m_drawViews;
+    std::size_t m_passes;
 
     void updateFrustum();
+    void plan();
+    void rasterize(const straw::region &clip);
 
-    template<class T>
-    void translateShape(T &shape);
+    std::uint32_t style(straw::color fg, straw::color bg, char c, int layer);
+    void push(const shapes::point<long> &s, std::uint32_t style, std::uint32_t pick) { m_batches[POINT].push(s.position[0], s.position[1], 0, 0, style, pick); }
+    void push(const shapes::line<long> &s, std::uint32_t style, std::uint32_t pick) { m_batches[LINE].push(s.position[0], s.position[1], s.end[0], s.end[1], style, pick); }
+    void push(const shapes::circle<long> &s, std::uint32_t style, std::uint32_t pick) { m_batches[CIRCLE].push(s.position[0], s.position[1], s.radius, s.radius, style, pick); }
+    void push(const shapes::ellipse<long> &s, std::uint32_t style, std::uint32_t pick) { m_batches[ELLIPSE].push(s.position[0], s.position[1], s.a, s.b, style, pick); }
+    void push(const shapes::rectangle<long> &s, std::uint32_t style, std::uint32_t pick) { m_batches[RECTANGLE].push(s.position[0], s.position[1], s.bounds[0], s.bounds[1], style, pick); }
+
+    void transform(ShapeArrays &batch, bool endpoints);
+    void cull(ShapeKind kind);
+    void sortDrawList();
+    void rowSpan(const DrawItem &item, long &lo, long &hi) const;
+    void colSpan(const DrawItem &item, long &lo, long &hi) const;
+    void binDrawList();
+    bool covered(const Tile &tile, const DrawItem &item) const;
+    bool scrollpays() const;
+    void drawTile(const Tile &tile);
+
+    void plotPoint(const straw::region &clip, long x, long y, const straw::cell<char> &cell, std::uint32_t pick);
+    void plotLine(const straw::region &clip, long x0, long y0, long x1, long y1, const straw::cell<char> &cell, std::uint32_t pick);
+    void plotRectangle(const straw::region &clip, long x, long y, long w, long h, const straw::cell<char> &cell, std::uint32_t pick);
+    void plotCircle(const straw::region &clip, long x, long y, long r, const straw::cell<char> &cell, std::uint32_t pick);
+    void plotEllipse(const straw::region &clip, long x, long y, long a, long b, const straw::cell<char> &cell, std::uint32_t pick);
 public:
     Camera(straw::screen<char> *viewport) :
         m_position(0, 0),
@@ -60,37 +217,68 @@ public:
         m_frustum(0, 0, 0, 0),
         m_scale(16384),
         m_dirty(true),
-        m_viewport(viewport) {}
+        m_repaint(true),
+        m_viewport(viewport),
+        m_raster(viewport->getwidth(), viewport->getheight()),
+        m_clip{},
+        m_reuse(false),
+        m_shiftX(0), m_shiftY(0),
+        m_clips{},
+        m_drawViews{shapes::rectangle<long>(0, 0, 0, 0), shapes::rectangle<long>(0, 0, 0, 0)},
+        m_passes(0) {}
     ~Camera() {}
 
     constexpr long getscale() const { return m_scale; }
     constexpr vex::vec2<long> getpos() const { return m_position; }
     constexpr vex::vec2<long> getorigin() const { return m_origin; }
 
+    /*World space rectangle covered by the viewport*/
+    shapes::rectangle<long> getview() const {
+        vex::vec2<long> dims(((long)m_viewport->getwidth()) * m_scale, ((long)m_viewport->getheight()) * m_scale);
+        return shapes::rectangle<long>(m_position + m_origin - (dims / 2L), dims);
+    }
+
+    /*World space rectangles this frame rasterizes, only the strips a pan
+     * uncovered when the rest of the last frame can be moved over. Each
+     * covers whole cells, so a grid of getscale() squares laid from its
+     * corner lines up with the screen*/
+    std::span<const shapes::rectangle<long>> getdrawviews();
+
     constexpr bool dirty() const { return m_dirty; }
-    void markDirty() { m_dirty = true; }
+    void markDirty() { m_dirty = m_repaint = true; }
 
-    void zoom(long by) { m_scale = std::max((unsigned)((int)m_scale + by), (unsigned)1); m_dirty = true; }
-    void setscale(long scale) { m_scale = std::max(scale, (long)1); m_dirty = true; }
+    void zoom(long by) { m_scale = std::max((unsigned)((int)m_scale + by), (unsigned)1); markDirty(); }
+    void setscale(long scale) { m_scale = std::max(scale, (long)1); markDirty(); }
 
+    /*Panning by whole cells only rasterizes the strip it uncovers*/
     void move(const vex::vec2<long> &pos) { m_position += pos; m_dirty = true; }
     void move(long x, long y) { move(vex::vec2<long>(x, y)); }
 
-    void setpos(const vex::vec2<long> &pos) { m_position = pos; m_dirty = true; }
+    void setpos(const vex::vec2<long> &pos) { m_position = pos; markDirty(); }
     void setpos(long x, long y) { setpos(vex::vec2<long>(x, y)); }
 
-    void setorigin(const vex::vec2<long> &origin) { m_origin = origin; m_dirty = true; }
+    void setorigin(const vex::vec2<long> &origin) { m_origin = origin; markDirty(); }
 
+    /*Shapes given a pick id leave it in every cell they end up showing in*/
     template<class T>
-    void batchShape(T shape) { m_shapeBatch.emplace_back(shape); }
+    void batchShape(const T &shape) { push(shape, style(straw::WHITE, straw::BLACK, '#', 0), NO_PICK); }
     template<class T>
-    void batchShape(T shape, char c) { m_shapeBatch.emplace_back(shape, c); }
+    void batchShape(const T &shape, char c) { push(shape, style(straw::WHITE, straw::BLACK, c, 0), NO_PICK); }
     template<class T>
-    void batchShape(T shape, straw::color fg, char c) { m_shapeBatch.emplace_back(shape, fg, c); }
+    void batchShape(const T &shape, straw::color fg, char c, int layer = 0, std::uint32_t pick = NO_PICK) {
+        push(shape, style(fg, straw::BLACK, c, layer), pick);
+    }
     template<class T>
-    void batchShape(T shape, straw::color fg, straw::color bg, char c) { m_shapeBatch.emplace_back(shape, fg, bg, c); }
+    void batchShape(const T &shape, straw::color fg, straw::color bg, char c, int layer = 0, std::uint32_t pick = NO_PICK) {
+        push(shape, style(fg, bg, c, layer), pick);
+    }
 
     void draw();
+
+    /*Pick id shown at viewport cell (x, y) in the last frame drawn*/
+    std::uint32_t pick(unsigned x, unsigned y) const {
+        return x < m_raster.width && y < m_raster.height ? m_raster.pick(x, y) : NO_PICK;
+    }
 };
 
 #endif
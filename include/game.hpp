@@ -40,7 +40,7 @@ private:
     static std::unordered_map<std::string, WindowContext> m_contexts;
     static std::string m_currentContext;
     
-    static std::unique_ptr<Camera> m_camera;
+    static std::vector<std::unique_ptr<Camera>> m_cameras;
     static std::unique_ptr<System> m_system;
     static SystemView m_systemView;
     
@@ -13,7 +13,18 @@ enum extkeys {
     CTRL_KEY_END = 326,
     CTRL_KEY_HOME = 328,
     CTRL_KEY_PAGEUP,
-    CTRL_KEY_PAGEDOWN
+    CTRL_KEY_PAGEDOWN,
+    CTRL_KEY_MOUSE = 512
+};
+
+/*Last mouse report, read when getcode returns CTRL_KEY_MOUSE. Cells count
+ * from 0 at the top left of the terminal*/
+struct MouseEvent {
+    unsigned button;
+    unsigned x, y;
+    bool pressed;
+
+    bool leftclick() const { return pressed && button == 0; }
 };
 
 #ifdef __unix__
@@ -66,6 +77,7 @@ public:
 #endif
 
 extern int getcode();
+extern const MouseEvent &getmouse();
 }
 
 #endif
@@ -24,6 +24,8 @@
 #define BIND_SYSTEMVIEW_DECSCALE "Systemview_DecScale"
 #define BIND_SYSTEMVIEW_INCSCALE "Systemview_IncScale"
 #define BIND_SYSTEMVIEW_SEARCH "Systemview_Search"
+#define BIND_SYSTEMVIEW_ORBITS "Systemview_Orbits"
+#define BIND_SYSTEMVIEW_FOLLOW "Systemview_Follow"
 
 #define BIND_SYSTEMVIEW_SEARCH_PREV "Systemview_Search_Prev"
 #define BIND_SYSTEMVIEW_SEARCH_NEXT "Systemview_Search_Next"
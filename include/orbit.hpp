@@ -0,0 +1,31 @@
+#ifndef ORBIT_HPP
+#define ORBIT_HPP 1
+
+#include "vex.hpp"
+#include "entitycomponents.hpp"
+
+#include <vector>
+#include <numbers>
+
+namespace orbit {
+
+constexpr double tau = std::numbers::pi * 2;
+
+/*Solves Kepler's equation M = E - e*sin(E) for the eccentric anomaly*/
+double eccentricAnomaly(double M, double e);
+
+/*Angle from periapsis at eccentric anomaly E*/
+double trueAnomaly(double e, double E);
+
+/*Position relative to the orbited body at eccentric anomaly E*/
+vex::vec2<long> position(const ecs::OrbitalComponent &oc, double E);
+
+/*Closed polyline of an orbit around its origin, in the orbit's local frame.
+ * Sampled in eccentric anomaly and subdivided until no segment strays further
+ * than tolerance from the true ellipse.*/
+using Path = std::vector<vex::vec2<long>>;
+Path path(const ecs::OrbitalComponent &oc, long tolerance);
+
+}
+
+#endif
@@ -15,8 +15,7 @@ struct shape
     constexpr shape(const vex::vec2<T> p) : position(p) {}
     constexpr shape(T x, T y) : position(x, y) {}
 
-    virtual void scale(T by) = 0;
-    virtual void translate(vex::vec2<T> by) { position += by; }
+    void translate(vex::vec2<T> by) { position += by; }
 };
 
 template<vex::arithmetic T>
@@ -25,7 +24,7 @@ struct point : public shape<T>
     constexpr point(T x, T y) : shape<T>(vex::vec2<T>(x, y)) {}
     constexpr point(const vex::vec2<T> &pos) : shape<T>(pos) {}
 
-    void scale(T by) override { (void)by; }
+    void scale(T by) { (void)by; }
 };
 
 template<vex::arithmetic T>
@@ -40,7 +39,7 @@ struct line : public shape<T>
         this->position += by;
         end += by;
     }
-    void scale(T by) override {
+    void scale(T by) {
         end = vex::vec2<T>(
         (T)std::floor((double)end[0] / (double)by),
         (T)std::floor((double)end[1] / (double)by));
@@ -54,7 +53,7 @@ struct circle : public shape<T>
     constexpr circle(T x, T y, T r) : shape<T>(vex::vec2<T>(x, y)), radius(r) {}
     constexpr circle(const vex::vec2<T> &pos, T r) : shape<T>(pos), radius(r) {}
 
-    void scale(T by) override { radius /= by; }
+    void scale(T by) { radius /= by; }
 };
 
 template<vex::arithmetic T>
@@ -64,7 +63,7 @@ struct ellipse : public shape<T>
     constexpr ellipse(T x, T y, T A, T B) : shape<T>(x, y), a(A), b(B) {}
     constexpr ellipse(const vex::vec2<T> &pos, T A, T B) : shape<T>(pos), a(A), b(B) {}
 
-    void scale(T by) override {a /= by; b /= by; }
+    void scale(T by) {a /= by; b /= by; }
 };
 
 template<vex::arithmetic T>
@@ -74,7 +73,7 @@ struct rectangle : public shape<T>
     constexpr rectangle(T x, T y, T w, T h) : shape<T>(vex::vec2<T>(x, y)), bounds(w, h) {}
     constexpr rectangle(const vex::vec2<T> &pos, const vex::vec2<T> &wh) : shape<T>(pos), bounds(wh) {}
 
-    void scale(T by) override { bounds /= by; }
+    void scale(T by) { bounds /= by; }
 };
 
 template<vex::arithmetic T>
@@ -0,0 +1,115 @@
+#ifndef SPATIAL_HPP
+#define SPATIAL_HPP 1
+
+#include "vex.hpp"
+#include "shape.hpp"
+
+#include <vector>
+#include <array>
+#include <cstddef>
+
+namespace spatial {
+
+/*Loose quadtree over entity positions.
+ * Every node owns a square region, but accepts entries anywhere within twice
+ * that region, so a body drifting across a boundary only costs a position
+ * update instead of a reinsertion.*/
+class QuadTree {
+    static constexpr std::size_t NODE_CAPACITY = 16;
+    static constexpr unsigned MAX_DEPTH = 32;
+
+    struct Node {
+        vex::vec2<long> center;
+        long half;
+        unsigned depth;
+        int children;
+        int parent;
+        std::size_t count; /*Entries in this node and every node below it*/
+        std::vector<unsigned> entries;
+    };
+    struct Entry {
+        vex::vec2<long> position{0, 0};
+        int node = -1;
+        unsigned slot = 0;
+    };
+
+    std::vector<Node> m_nodes;
+    std::vector<Entry> m_entries;
+    std::size_t m_size;
+
+    bool looseContains(const Node &node, const vex::vec2<long> &position) const;
+    bool looseIntersects(const Node &node, const shapes::rectangle<long> &rect) const;
+    unsigned quadrant(const Node &node, const vex::vec2<long> &position) const;
+
+    void place(int nodeIndex, unsigned id);
+    void split(int nodeIndex);
+    void detach(unsigned id);
+    unsigned firstEntry(int nodeIndex) const;
+
+    template<typename F>
+    void queryNode(int nodeIndex, long x0, long y0, long x1, long y1, const shapes::rectangle<long> &rect, F &fn) const {
+        const Node &node = m_nodes[nodeIndex];
+        if(!looseIntersects(node, rect)) return;
+        for(unsigned id : node.entries) {
+            const vex::vec2<long> &p = m_entries[id].position;
+            if(p[0] >= x0 && p[0] < x1 && p[1] >= y0 && p[1] < y1) fn(id);
+        }
+        if(node.children < 0) return;
+        for(int i = 0; i < 4; i++) queryNode(node.children + i, x0, y0, x1, y1, rect, fn);
+    }
+
+    template<typename F>
+    void densityNode(int nodeIndex, const shapes::rectangle<long> &rect, long cell, F &fn) const {
+        const Node &node = m_nodes[nodeIndex];
+        if(node.count == 0 || !looseIntersects(node, rect)) return;
+        long x0 = rect.position[0], y0 = rect.position[1];
+        long x1 = x0 + rect.bounds[0], y1 = y0 + rect.bounds[1];
+        if(node.depth > 0) {
+            //Everything this node can hold lands in one cell, so its count is enough
+            long reach = node.half * 2;
+            vex::vec2<long> lo = node.center - vex::vec2<long>(reach, reach);
+            vex::vec2<long> hi = node.center + vex::vec2<long>(reach - 1, reach - 1);
+            if(lo[0] >= x0 && lo[1] >= y0 && hi[0] < x1 && hi[1] < y1 &&
+               (lo[0] - x0) / cell == (hi[0] - x0) / cell && (lo[1] - y0) / cell == (hi[1] - y0) / cell) {
+                fn((lo[0] - x0) / cell, (lo[1] - y0) / cell, node.count, firstEntry(nodeIndex));
+                return;
+            }
+        }
+        for(unsigned id : node.entries) {
+            const vex::vec2<long> &p = m_entries[id].position;
+            if(p[0] >= x0 && p[0] < x1 && p[1] >= y0 && p[1] < y1) fn((p[0] - x0) / cell, (p[1] - y0) / cell, 1, id);
+        }
+        if(node.children < 0) return;
+        for(int i = 0; i < 4; i++) densityNode(node.children + i, rect, cell, fn);
+    }
+public:
+    explicit QuadTree(long halfsize);
+
+    void insert(unsigned id, const vex::vec2<long> &position);
+    void update(unsigned id, const vex::vec2<long> &position);
+    void remove(unsigned id);
+
+    bool contains(unsigned id) const { return id < m_entries.size() && m_entries[id].node >= 0; }
+    std::size_t size() const { return m_size; }
+
+    /*Calls fn(id) for every entry whose position lies inside rect*/
+    template<typename F>
+    void query(const shapes::rectangle<long> &rect, F &&fn) const {
+        long x0 = rect.position[0], y0 = rect.position[1];
+        queryNode(0, x0, y0, x0 + rect.bounds[0], y0 + rect.bounds[1], rect, fn);
+    }
+
+    /*Counts the entries in a grid of cell sized squares laid from rect's corner,
+     * calling fn(i, j, n, id) for n more entries in cell (i, j), id being one
+     * of them. A cell can be reported several times. Subtrees that fit in one
+     * cell are counted whole, so the cost follows the number of cells rather
+     * than entries*/
+    template<typename F>
+    void density(const shapes::rectangle<long> &rect, long cell, F &&fn) const {
+        densityNode(0, rect, cell, fn);
+    }
+};
+
+}
+
+#endif
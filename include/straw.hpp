@@ -9,8 +9,24 @@
 #include <string>
 #include <concepts>
 #include <cassert>
-#include <iostream>
 #include <algorithm>
+#include <charconv>
+#include <string_view>
+#include <bit>
+#include <cstring>
+#include <cstdlib>
+#include <type_traits>
+#include <array>
+#include <utility>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+#include <unistd.h>
+#include <poll.h>
+#include <cerrno>
 
 namespace straw
 {
@@ -28,13 +44,22 @@ struct color {
 static constexpr color WHITE{255, 255, 255};
 static constexpr color BLACK{0, 0, 0};
 
+/*Packed to 7 bytes so a cell<char> is exactly one 64 bit word*/
 struct attribs {
+    static constexpr std::uint8_t BOLD = 1 << 0;
+    static constexpr std::uint8_t UNDERLINE = 1 << 1;
+
     color bg{0, 0, 0}, fg{255, 255, 255};
-    bool bold, underline;
+    std::uint8_t flags{};
     constexpr attribs() = default;
     constexpr attribs(color Fg) : fg(Fg) {}
     constexpr attribs(color Bg, color Fg) : bg(Bg), fg(Fg) {}
-    constexpr attribs(color Bg, color Fg, bool B, bool U) : bg(Bg), fg(Fg), bold(B), underline(U) {}
+    constexpr attribs(color Bg, color Fg, bool B, bool U) : bg(Bg), fg(Fg), flags((B ? BOLD : 0) | (U ? UNDERLINE : 0)) {}
+
+    constexpr bool bold() const { return flags & BOLD; }
+    constexpr bool underline() const { return flags & UNDERLINE; }
+    constexpr void setbold(bool b) { flags = b ? (flags | BOLD) : (flags & ~BOLD); }
+    constexpr void setunderline(bool u) { flags = u ? (flags | UNDERLINE) : (flags & ~UNDERLINE); }
 
     constexpr bool operator==(const attribs &o) const = default;
 };
@@ -42,6 +67,12 @@ struct attribs {
 template<typename T>
 concept char_type = std::integral<T>;
 
+//Types a stream prints as a character rather than a number
+template<typename T>
+inline constexpr bool is_character =
+    std::is_same_v<T, char> || std::is_same_v<T, signed char> || std::is_same_v<T, unsigned char> ||
+    std::is_same_v<T, wchar_t> || std::is_same_v<T, char8_t> || std::is_same_v<T, char16_t> || std::is_same_v<T, char32_t>;
+
 template<char_type chartype>
 struct cell {
     chartype chr{};
@@ -54,26 +85,501 @@ struct cell {
     constexpr cell(chartype Chr, color Bg, color Fg, bool B, bool U) : chr(Chr), attr(Bg, Fg, B, U) {}
     constexpr cell(chartype Chr, attribs Attr) : chr(Chr), attr(Attr) {}
 
-    constexpr bool operator==(const cell &o) const = default;
+    /*Padding free cells compare as raw bytes, a single load for cell<char>*/
+    static constexpr bool packed = std::has_unique_object_representations_v<attribs> &&
+        sizeof(chartype) + sizeof(attribs) == sizeof(std::uint64_t);
+
+    constexpr bool operator==(const cell &o) const {
+        if constexpr(packed) {
+            return std::bit_cast<std::uint64_t>(*this) == std::bit_cast<std::uint64_t>(o);
+        }else{
+            return chr == o.chr && attr == o.attr;
+        }
+    }
+};
+static_assert(sizeof(cell<char>) == sizeof(std::uint64_t));
+static_assert(std::has_unique_object_representations_v<cell<char>>);
+
+/*How many colors the terminal can show. Anything short of truecolor gets
+ * colors quantized to the xterm palette*/
+enum class colormode { TRUECOLOR, COLOR256, COLOR16 };
+
+inline bool
+parsecolormode(std::string_view name, colormode &mode)
+{
+    if(name == "truecolor" || name == "24bit" || name == "24") mode = colormode::TRUECOLOR;
+    else if(name == "256") mode = colormode::COLOR256;
+    else if(name == "16") mode = colormode::COLOR16;
+    else return false;
+    return true;
+}
+
+/*Best guess from COLORTERM and TERM, falling back to 16 colors*/
+inline colormode
+detectcolormode(const char *colorterm, const char *termname)
+{
+    std::string_view ct = colorterm == nullptr ? "" : colorterm;
+    std::string_view tn = termname == nullptr ? "" : termname;
+    if(ct == "truecolor" || ct == "24bit") return colormode::TRUECOLOR;
+    if(tn.find("direct") != std::string_view::npos) return colormode::TRUECOLOR;
+    if(tn.find("256") != std::string_view::npos) return colormode::COLOR256;
+    return colormode::COLOR16;
+}
+
+/*Maps colors to palette indices. Lookups go through a small direct mapped
+ * cache since a frame only uses a handful of distinct colors*/
+class quantizer {
+    static constexpr std::size_t CACHE_SIZE = 256;
+    static constexpr std::uint32_t VALID = 1u << 24;
+
+    struct slot {
+        std::uint32_t key{};
+        std::uint8_t index{};
+    };
+    std::array<slot, CACHE_SIZE> m_cache{};
+    colormode m_mode{colormode::TRUECOLOR};
+
+    static constexpr std::array<color, 16> PALETTE16{{
+        {0, 0, 0}, {205, 0, 0}, {0, 205, 0}, {205, 205, 0},
+        {0, 0, 238}, {205, 0, 205}, {0, 205, 205}, {229, 229, 229},
+        {127, 127, 127}, {255, 0, 0}, {0, 255, 0}, {255, 255, 0},
+        {92, 92, 255}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255}
+    }};
+    static constexpr std::array<std::uint8_t, 6> CUBE{0, 95, 135, 175, 215, 255};
+
+    static constexpr unsigned distance(color a, color b) {
+        int dr = a.r - b.r, dg = a.g - b.g, db = a.b - b.b;
+        return (unsigned)(dr * dr + dg * dg + db * db);
+    }
+    static constexpr unsigned cubelevel(std::uint8_t v) {
+        return v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40;
+    }
+
+    static std::uint8_t nearest16(color c) {
+        unsigned best = 0, bestdist = distance(c, PALETTE16[0]);
+        for(unsigned i = 1; i < PALETTE16.size(); i++) {
+            unsigned d = distance(c, PALETTE16[i]);
+            if(d < bestdist) { best = i; bestdist = d; }
+        }
+        return (std::uint8_t)best;
+    }
+    //Closest of the 6x6x6 cube and the 24 step gray ramp
+    static std::uint8_t nearest256(color c) {
+        unsigned r = cubelevel(c.r), g = cubelevel(c.g), b = cubelevel(c.b);
+        color cube{CUBE[r], CUBE[g], CUBE[b]};
+        unsigned avg = (c.r + c.g + c.b) / 3;
+        unsigned step = avg < 8 ? 0 : std::min((avg - 3) / 10, 23u);
+        std::uint8_t level = (std::uint8_t)(8 + step * 10);
+        if(distance(c, color{level}) < distance(c, cube)) return (std::uint8_t)(232 + step);
+        return (std::uint8_t)(16 + 36 * r + 6 * g + b);
+    }
+public:
+    colormode mode() const { return m_mode; }
+    void setmode(colormode mode) {
+        m_mode = mode;
+        m_cache.fill(slot{});
+    }
+
+    std::uint8_t index(color c) {
+        std::uint32_t key = c.single() | VALID;
+        slot &s = m_cache[(key * 0x9E3779B1u) >> 24];
+        if(s.key != key) {
+            s.key = key;
+            s.index = m_mode == colormode::COLOR16 ? nearest16(c) : nearest256(c);
+        }
+        return s.index;
+    }
 };
 
-const std::string ANSI_ESCAPE = "\E[";
-static void ANSI_MOVE(unsigned x, unsigned y) { std::cout << ANSI_ESCAPE << y+1 << ';' << x+1 << 'H' << std::flush; }
-static void ANSI_COLOR_FG(color c) { std::cout << ANSI_ESCAPE << "38;2;" << (unsigned)c.r << ';' << (unsigned)c.g << ';' << (unsigned)c.b << 'm' << std::flush; }
-static void ANSI_COLOR_BG(color c) { std::cout << ANSI_ESCAPE << "48;2;" << (unsigned)c.r << ';' << (unsigned)c.g << ';' << (unsigned)c.b << 'm' << std::flush; }
+/*Output to the terminal, gathered into one buffer and written once a frame.
+ * Tracks where the cursor is and which attributes are set, so each cell
+ * costs as few bytes as the escape sequences allow.*/
+class terminal {
+    std::string m_buffer;
+    int m_fd;
+
+    unsigned m_width{}, m_height{};
+    unsigned m_cx{}, m_cy{};
+    bool m_cursorKnown{};
+    attribs m_attr{};
+    bool m_attrKnown{};
+    bool m_rep{true};
+    bool m_sync{};
+    bool m_margins{};
+    std::size_t m_frameBudget{};
+    quantizer m_quantizer;
+    std::uint8_t m_fgIndex{}, m_bgIndex{};
+
+    static constexpr unsigned digits(unsigned n) { unsigned d = 1; while(n >= 10) { n /= 10; d++; } return d; }
+    //Length of a CSI sequence whose single parameter defaults to 1
+    static constexpr unsigned csilen(unsigned n) { return 3 + (n == 1 ? 0 : digits(n)); }
+
+    void csi(unsigned n, char f) {
+        put('\x1b'); put('[');
+        if(n != 1) putn(n);
+        put(f);
+    }
+
+    enum class hmove { NONE, CR, BS, CUF, CUB, CHA, CRCUF };
+    unsigned hcost(unsigned from, unsigned to, hmove &how) const {
+        how = hmove::CHA;
+        unsigned best = csilen(to + 1);
+        auto consider = [&](hmove h, unsigned cost) { if(cost < best) { best = cost; how = h; } };
+        if(to == from) consider(hmove::NONE, 0);
+        if(to == 0) consider(hmove::CR, 1);
+        if(to > from) consider(hmove::CUF, csilen(to - from));
+        if(to > 0) consider(hmove::CRCUF, 1 + csilen(to));
+        if(to + 1 == from) consider(hmove::BS, 1);
+        if(to < from) consider(hmove::CUB, csilen(from - to));
+        return best;
+    }
+    void hemit(unsigned from, unsigned to, hmove how) {
+        switch(how) {
+            case hmove::NONE: break;
+            case hmove::CR: put('\r'); break;
+            case hmove::BS: put('\b'); break;
+            case hmove::CUF: csi(to - from, 'C'); break;
+            case hmove::CUB: csi(from - to, 'D'); break;
+            case hmove::CHA: csi(to + 1, 'G'); break;
+            case hmove::CRCUF: put('\r'); csi(to, 'C'); break;
+        }
+    }
+
+    unsigned cupcost(unsigned x, unsigned y) const {
+        if(x == 0) return 3 + (y == 0 ? 0 : digits(y + 1));
+        return 4 + (y == 0 ? 0 : digits(y + 1)) + digits(x + 1);
+    }
+
+    /*Cheapest way from the tracked cursor to (x, y); relative moves need a known cursor*/
+    unsigned plan(unsigned x, unsigned y, hmove &how, bool &absolute) const {
+        absolute = true;
+        unsigned best = cupcost(x, y);
+        if(!m_cursorKnown) return best;
+        unsigned vcost = 0;
+        if(y != m_cy) vcost = std::min(csilen(y > m_cy ? y - m_cy : m_cy - y), csilen(y + 1));
+        unsigned rel = vcost + hcost(m_cx, x, how);
+        if(rel < best) {
+            best = rel;
+            absolute = false;
+        }
+        return best;
+    }
+    template<typename F>
+    void setcolor(color c, bool foreground, F &param) {
+        colormode mode = m_quantizer.mode();
+        if(mode == colormode::TRUECOLOR) {
+            param(); puts(foreground ? "38;2;" : "48;2;");
+            putn(c.r); put(';'); putn(c.g); put(';'); putn(c.b);
+            return;
+        }
+        std::uint8_t index = m_quantizer.index(c);
+        std::uint8_t &current = foreground ? m_fgIndex : m_bgIndex;
+        if(m_attrKnown && index == current) return;
+        current = index;
+        param();
+        if(mode == colormode::COLOR256) {
+            puts(foreground ? "38;5;" : "48;5;");
+            putn(index);
+        }else{
+            putn((foreground ? 30 : 40) + (index < 8 ? index : index - 8 + 60));
+        }
+    }
+public:
+    explicit terminal(int fd) : m_fd(fd) { m_buffer.reserve(1 << 16); }
+
+    void resize(unsigned w, unsigned h) { m_width = w; m_height = h; m_cursorKnown = false; }
+    void setrep(bool rep) { m_rep = rep; }
+    /*Wraps each presented frame in DEC 2026 so the terminal shows it whole.
+     * Off until probe finds support or an option asks for it*/
+    void setsync(bool sync) { m_sync = sync; }
+    /*DECLRMM, needed to scroll regions narrower than the terminal. Off until
+     * probe finds support or an option asks for it*/
+    void setmargins(bool margins) { m_margins = margins; }
+
+    /*Mouse button reports (1000) in SGR form (1006), sent with the next frame*/
+    void setmouse(bool mouse) { puts(mouse ? "\x1b[?1000h\x1b[?1006h" : "\x1b[?1006l\x1b[?1000l"); }
+
+    /*Asks through DECRQM whether the terminal knows DEC 2026 and DECLRMM, then
+     * sends DA1, which every terminal answers, so the wait ends once the replies
+     * are in. Whatever is supported gets turned on, options already set stay on.
+     * in has to be raw and not read by anything else yet*/
+    void probe(int in, int timeout = 250) {
+        writeall("\x1b[?2026$p\x1b[?69$p\x1b[c");
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+        std::string reply;
+        for(;;) {
+            //Replies are ESC [ ? mode ; value $ y, and ESC [ ? ... c for DA1
+            std::size_t at = 0;
+            bool done = false;
+            while((at = reply.find("\x1b[?", at)) != std::string::npos) {
+                at += 3;
+                std::size_t end = reply.find_first_not_of("0123456789;", at);
+                if(end == std::string::npos) break;
+                if(reply[end] == 'c') done = true;
+                unsigned mode = 0, value = 0;
+                auto [semi, err] = std::from_chars(reply.data() + at, reply.data() + end, mode);
+                if(err == std::errc() && semi < reply.data() + end && *semi == ';' && reply.compare(end, 2, "$y") == 0) {
+                    std::from_chars(semi + 1, reply.data() + end, value);
+                    //1 set, 2 reset, 3 permanently set
+                    bool supported = value >= 1 && value <= 3;
+                    if(mode == 2026) m_sync = m_sync || supported;
+                    if(mode == 69) m_margins = m_margins || supported;
+                }
+            }
+            if(done) return;
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+            if(left <= 0) return;
+            struct pollfd pfd{in, POLLIN, 0};
+            if(poll(&pfd, 1, (int)left) <= 0) continue;
+            char buf[64];
+            ssize_t n = ::read(in, buf, sizeof(buf));
+            if(n > 0) reply.append(buf, (std::size_t)n);
+        }
+    }
+
+    bool canscroll(unsigned x0, unsigned x1) const { return (x0 == 0 && x1 >= m_width) || m_margins; }
+
+    /*Scrolls the cells in [x0, x1) x [y0, y1) up by n rows, or down by -n,
+     * inside temporary margins. What scrolls in is blank in whatever colour
+     * the terminal picks*/
+    void scroll(unsigned x0, unsigned y0, unsigned x1, unsigned y1, int n) {
+        bool full = x0 == 0 && x1 >= m_width;
+        puts("\x1b["); putn(y0 + 1); put(';'); putn(y1); put('r');
+        if(!full) {
+            puts("\x1b[?69h\x1b["); putn(x0 + 1); put(';'); putn(x1); put('s');
+        }
+        csi((unsigned)std::abs(n), n > 0 ? 'S' : 'T');
+        if(!full) puts("\x1b[?69l");
+        puts("\x1b[r");
+        //Setting margins homes the cursor
+        m_cursorKnown = false;
+    }
+
+    /*Bytes a frame may encode before the rest is deferred, 0 for no limit*/
+    std::size_t framebudget() const { return m_frameBudget; }
+    void setframebudget(std::size_t budget) { m_frameBudget = budget; }
+
+    void put(char c) { m_buffer.push_back(c); }
+    void puts(std::string_view s) { m_buffer.append(s); }
+    void putn(unsigned n) {
+        char digits[16];
+        auto res = std::to_chars(digits, digits + sizeof(digits), n);
+        m_buffer.append(digits, res.ptr);
+    }
+
+    /*Puts a character at the cursor, encoding wider characters as UTF-8*/
+    template<char_type chartype>
+    void putc(chartype c) {
+        std::uint32_t cp = (std::uint32_t)c;
+        if constexpr(sizeof(chartype) == 1) {
+            put((char)c);
+        }else if(cp < 0x80) {
+            put((char)cp);
+        }else if(cp < 0x800) {
+            put((char)(0xC0 | (cp >> 6)));
+            put((char)(0x80 | (cp & 0x3F)));
+        }else if(cp < 0x10000) {
+            put((char)(0xE0 | (cp >> 12)));
+            put((char)(0x80 | ((cp >> 6) & 0x3F)));
+            put((char)(0x80 | (cp & 0x3F)));
+        }else{
+            put((char)(0xF0 | (cp >> 18)));
+            put((char)(0x80 | ((cp >> 12) & 0x3F)));
+            put((char)(0x80 | ((cp >> 6) & 0x3F)));
+            put((char)(0x80 | (cp & 0x3F)));
+        }
+        //Writing the last column leaves the terminal waiting to wrap
+        if(++m_cx >= m_width) m_cursorKnown = false;
+    }
+
+    /*Repeats the last character put n more times*/
+    template<char_type chartype>
+    void repeat(chartype c, unsigned n) {
+        if(n == 0) return;
+        if(m_rep && csilen(n) < n) {
+            csi(n, 'b');
+            m_cx += n;
+            if(m_cx >= m_width) m_cursorKnown = false;
+            return;
+        }
+        for(unsigned i = 0; i < n; i++) putc(c);
+    }
+
+    unsigned movecost(unsigned x, unsigned y) const {
+        hmove how; bool absolute;
+        return plan(x, y, how, absolute);
+    }
+
+    void moveto(unsigned x, unsigned y) {
+        hmove how; bool absolute;
+        plan(x, y, how, absolute);
+        if(absolute) {
+            put('\x1b'); put('[');
+            if(y != 0) putn(y + 1);
+            if(x != 0) { put(';'); putn(x + 1); }
+            put('H');
+        }else{
+            if(y != m_cy) {
+                unsigned dy = y > m_cy ? y - m_cy : m_cy - y;
+                if(csilen(dy) <= csilen(y + 1)) csi(dy, y > m_cy ? 'B' : 'A');
+                else csi(y + 1, 'd');
+            }
+            hemit(m_cx, x, how);
+        }
+        m_cx = x; m_cy = y;
+        m_cursorKnown = true;
+    }
+
+    /*Cursor column if it sits on row y*/
+    bool onrow(unsigned y, unsigned &x) const {
+        x = m_cx;
+        return m_cursorKnown && m_cy == y;
+    }
+
+    colormode getcolormode() const { return m_quantizer.mode(); }
+    void setcolormode(colormode mode) {
+        m_quantizer.setmode(mode);
+        m_attrKnown = false;
+    }
+
+    bool hasattr(const attribs &attr) const { return m_attrKnown && m_attr == attr; }
+
+    /*One SGR carrying only the attributes that changed*/
+    void setattr(const attribs &attr) {
+        if(hasattr(attr)) return;
+        bool first = true;
+        auto param = [&]() { if(!first) put(';'); first = false; };
+        put('\x1b'); put('[');
+        if(!m_attrKnown || attr.fg != m_attr.fg) setcolor(attr.fg, true, param);
+        if(!m_attrKnown || attr.bg != m_attr.bg) setcolor(attr.bg, false, param);
+        if(!m_attrKnown || attr.bold() != m_attr.bold()) { param(); puts(attr.bold() ? "1" : "22"); }
+        if(!m_attrKnown || attr.underline() != m_attr.underline()) { param(); puts(attr.underline() ? "4" : "24"); }
+        if(first) {
+            //Every color that changed mapped to the palette entry already set
+            m_buffer.resize(m_buffer.size() - 2);
+        }else{
+            put('m');
+        }
+        m_attr = attr;
+        m_attrKnown = true;
+    }
+
+    std::size_t pending() const { return m_buffer.size(); }
+
+    /*True while the writer has no frame waiting. A frame that is not encoded
+     * keeps its cells dirty, so skipped frames merge into the next one*/
+    bool ready() {
+        std::lock_guard lock(m_writerLock);
+        return m_queued.empty();
+    }
+
+    /*Hands everything buffered to the writer thread without waiting on the terminal*/
+    void present() {
+        if(m_buffer.empty()) return;
+        if(m_sync) {
+            m_buffer.insert(0, "\x1b[?2026h");
+            m_buffer.append("\x1b[?2026l");
+        }
+        {
+            std::lock_guard lock(m_writerLock);
+            if(!m_writer.joinable()) m_writer = std::thread(&terminal::writeloop, this);
+            //Frames queue up back to back, the escape stream stays in order
+            if(m_queued.empty()) m_queued.swap(m_buffer);
+            else m_queued.append(m_buffer);
+        }
+        m_buffer.clear();
+        m_writerWake.notify_one();
+    }
+
+    /*Blocks until the writer has sent everything presented so far*/
+    void finish() {
+        std::unique_lock lock(m_writerLock);
+        m_writerIdle.wait(lock, [this]() { return m_queued.empty() && !m_writing; });
+    }
+
+    ~terminal() {
+        {
+            std::lock_guard lock(m_writerLock);
+            m_stopping = true;
+        }
+        m_writerWake.notify_one();
+        if(m_writer.joinable()) m_writer.join();
+    }
+private:
+    std::thread m_writer;
+    std::mutex m_writerLock;
+    std::condition_variable m_writerWake, m_writerIdle;
+    std::string m_queued;
+    bool m_writing{};
+    bool m_stopping{};
+
+    /*The tty can share stdin's O_NONBLOCK, so wait out EAGAIN*/
+    void writeall(const std::string &data) {
+        std::size_t done = 0;
+        while(done < data.size()) {
+            ssize_t n = ::write(m_fd, data.data() + done, data.size() - done);
+            if(n >= 0) {
+                done += (std::size_t)n;
+            }else if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd pfd{m_fd, POLLOUT, 0};
+                poll(&pfd, 1, -1);
+            }else if(errno != EINTR) {
+                break;
+            }
+        }
+    }
+
+    void writeloop() {
+        std::string frame;
+        std::unique_lock lock(m_writerLock);
+        for(;;) {
+            m_writerWake.wait(lock, [this]() { return !m_queued.empty() || m_stopping; });
+            if(m_queued.empty()) return;
+            frame.swap(m_queued);
+            m_writing = true;
+            lock.unlock();
+            writeall(frame);
+            frame.clear();
+            lock.lock();
+            m_writing = false;
+            m_writerIdle.notify_all();
+        }
+    }
+};
+inline terminal term{STDOUT_FILENO};
 
 class screen_command_base {};
 
+struct coord {
+    unsigned x, y;
+};
+
+//Cells in [x0, x1) x [y0, y1)
+struct region {
+    unsigned x0, y0, x1, y1;
+};
+
+/*Tags a screen that is never sent to the terminal itself, only drained into another*/
+struct offscreen_t { explicit offscreen_t() = default; };
+inline constexpr offscreen_t offscreen{};
+
 template<char_type chartype>
 class screen {
 public:
     explicit screen(unsigned X, unsigned Y, unsigned W, unsigned H, chartype C, color B, color F) :
         m_x(X), m_y(Y), m_width(W), m_height(H), m_front(W * H, cell{C, B, F}), m_back(m_front),
+        m_dirty(H, dirtyspan{W, 0}), m_dirtyY0(H), m_dirtyY1(0),
         m_cursorAttribs(B,F), m_fillChar(C)
         {
             redraw();
         }
 
+    /*Starts out entirely dirty so whatever composes it picks up every cell*/
+    explicit screen(offscreen_t, unsigned X, unsigned Y, unsigned W, unsigned H) :
+        m_x(X), m_y(Y), m_width(W), m_height(H), m_front(W * H, cell{chartype(' ')}),
+        m_dirty(H, dirtyspan{0, W}), m_dirtyY0(0), m_dirtyY1(H),
+        m_fillChar(' '), m_offscreen(true) {}
+
     explicit screen(unsigned X, unsigned Y, unsigned W, unsigned H, chartype C) :
         screen(X, Y, W, H, C, color{0, 0, 0}, color{255, 255, 255}) {}
     explicit screen(unsigned X, unsigned Y, unsigned W, unsigned H) : 
@@ -84,35 +590,132 @@ public:
     constexpr void setcursorbg(uint8_t r, uint8_t g, uint8_t b) { m_cursorAttribs.bg = color{r, g, b}; }
     constexpr void setcursorfg(color c) { m_cursorAttribs.fg = c; }
     constexpr void setcursorbg(color c) { m_cursorAttribs.bg = c; }
-    constexpr void setcursorbold(bool bold) { m_cursorAttribs.bold = bold; }
-    constexpr void setcursorunderline(bool underline) { m_cursorAttribs.underline = underline; }
+    constexpr void setcursorbold(bool bold) { m_cursorAttribs.setbold(bold); }
+    constexpr void setcursorunderline(bool underline) { m_cursorAttribs.setunderline(underline); }
 
     constexpr unsigned getcursorx() { return m_cursorX; }
     constexpr unsigned getcursory() { return m_cursorY; }
-    constexpr unsigned getx() { return m_x; }
-    constexpr unsigned gety() { return m_y; }
-    constexpr unsigned getwidth() { return m_width; }
-    constexpr unsigned getheight() { return m_height; }
+    constexpr unsigned getx() const { return m_x; }
+    constexpr unsigned gety() const { return m_y; }
+    constexpr unsigned getwidth() const { return m_width; }
+    constexpr unsigned getheight() const { return m_height; }
 
-    void clear(const chartype c) { std::fill(m_front.begin(), m_front.end(), cell{c, m_cursorAttribs}); }
+    void clear(const chartype c) {
+        for(unsigned y = 0; y < m_height; y++) fill(y, 0, m_width, cell{c, m_cursorAttribs});
+    }
 
     void clearrow(unsigned y, const chartype c) {
         assert(y < m_height);
-        std::fill(m_front.begin() + (y * m_width),
-                m_front.begin() + (y * m_width) + m_width,
-                cell{c, m_cursorAttribs});
+        fill(y, 0, m_width, cell{c, m_cursorAttribs});
     }
 
     void scroll() {
         m_cursorY = m_height - 1;
-        std::copy(m_front.begin() + m_width, m_front.end(), m_front.begin());
-        std::fill(m_front.end() - m_width, m_front.end(), cell{m_fillChar, m_cursorAttribs});
+        scrollrows(1);
+    }
+
+    /*Moves every row up by n, or down by -n, blanking the rows left behind.
+     * Whatever composes an offscreen screen scrolls its copy too, so the
+     * dirty spans move with their rows and only the new rows are sent*/
+    void scrollrows(int n) {
+        unsigned k = (unsigned)std::abs(n);
+        if(k == 0) return;
+        const cell<chartype> blank{m_fillChar, m_cursorAttribs};
+        if(k >= m_height) {
+            std::fill(m_front.begin(), m_front.end(), blank);
+            if(m_offscreen) m_scrolled = 0;
+            touchall();
+            return;
+        }
+        std::size_t moved = (std::size_t)(m_height - k) * m_width, gap = (std::size_t)k * m_width;
+        if(n > 0) {
+            std::copy(m_front.begin() + gap, m_front.end(), m_front.begin());
+            std::fill(m_front.end() - gap, m_front.end(), blank);
+        }else{
+            std::copy_backward(m_front.begin(), m_front.begin() + moved, m_front.end());
+            std::fill(m_front.begin(), m_front.begin() + gap, blank);
+        }
+        if(!m_offscreen) {
+            touchall();
+            return;
+        }
+        if(n > 0) {
+            std::copy(m_dirty.begin() + k, m_dirty.end(), m_dirty.begin());
+            std::fill(m_dirty.end() - k, m_dirty.end(), dirtyspan{m_width, 0});
+            m_dirtyY0 = m_dirtyY0 > k ? m_dirtyY0 - k : 0;
+            m_dirtyY1 = m_dirtyY1 > k ? m_dirtyY1 - k : 0;
+            for(unsigned y = m_height - k; y < m_height; y++) touch(y, 0, m_width);
+        }else{
+            std::copy_backward(m_dirty.begin(), m_dirty.end() - k, m_dirty.end());
+            std::fill(m_dirty.begin(), m_dirty.begin() + k, dirtyspan{m_width, 0});
+            m_dirtyY0 = std::min(m_dirtyY0 + k, m_height);
+            m_dirtyY1 = std::min(m_dirtyY1 + k, m_height);
+            for(unsigned y = 0; y < k; y++) touch(y, 0, m_width);
+        }
+        m_scrolled += n;
+    }
+
+    /*Rows scrolled up since the last call, negative when they went down*/
+    int takescroll() { return std::exchange(m_scrolled, 0); }
+
+    void touchall() {
+        for(unsigned y = 0; y < m_height; y++) touch(y, 0, m_width);
+    }
+
+    /*Moves the cells of r up by n rows, or down by -n, with the terminal's
+     * scroll, keeping the back buffer in step. The rows left behind must be
+     * rewritten*/
+    void scroll(const region &r, int n) {
+        unsigned k = (unsigned)std::abs(n);
+        assert(!m_offscreen && r.x1 <= m_width && r.y1 <= m_height && r.y0 + k < r.y1);
+        term.scroll(m_x + r.x0, m_y + r.y0, m_x + r.x1, m_y + r.y1, n);
+        auto move = [&](unsigned to, unsigned from) {
+            std::size_t dst = (to * m_width) + r.x0, src = (from * m_width) + r.x0;
+            std::copy_n(m_front.begin() + src, r.x1 - r.x0, m_front.begin() + dst);
+            std::copy_n(m_back.begin() + src, r.x1 - r.x0, m_back.begin() + dst);
+            const dirtyspan &span = m_dirty[from];
+            unsigned x0 = std::max(span.x0, r.x0), x1 = std::min(span.x1, r.x1);
+            if(x0 < x1) touch(to, x0, x1);
+        };
+        unsigned b0 = r.y1 - k, b1 = r.y1;
+        if(n > 0) {
+            for(unsigned y = r.y0; y + k < r.y1; y++) move(y, y + k);
+        }else{
+            for(unsigned y = r.y1 - 1; y >= r.y0 + k; y--) move(y, y - k);
+            b0 = r.y0;
+            b1 = r.y0 + k;
+        }
+        //Never matches a real cell, so the blanks get painted over
+        for(unsigned y = b0; y < b1; y++) {
+            std::fill_n(m_back.begin() + (y * m_width) + r.x0, r.x1 - r.x0, cell{chartype(0)});
+            touch(y, r.x0, r.x1);
+        }
     }
 
     void setc(unsigned x, unsigned y, chartype c) {
         assert(x < m_width);
         assert(y < m_height);
-        m_front[x + (y * m_width)] = cell{c, m_cursorAttribs};
+        setcell(x, y, cell{c, m_cursorAttribs});
+    }
+
+    /*Raster writes. These take their attributes from the cell given rather than
+     * the cursor, and go straight into the front buffer*/
+    void plot(unsigned x, unsigned y, const cell<chartype> &c) {
+        assert(x < m_width);
+        assert(y < m_height);
+        setcell(x, y, c);
+    }
+
+    void plotmany(std::span<const coord> points, const cell<chartype> &c) {
+        for(const coord &p : points) plot(p.x, p.y, c);
+    }
+
+    //Fills [x0, x1) of row y, clipped to the screen width
+    void fillspan(unsigned y, unsigned x0, unsigned x1, const cell<chartype> &c) {
+        assert(y < m_height);
+        x1 = std::min(x1, m_width);
+        if(x0 >= x1) return;
+        fill(y, x0, x1, c);
     }
 
     void putc(chartype c){
@@ -124,8 +727,7 @@ public:
                 m_cursorX = 0; m_cursorY++;
                 break;
             default:
-                (*this)[m_cursorY][m_cursorX++] = 
-                    cell{c, m_cursorAttribs};
+                setcell(m_cursorX++, m_cursorY, cell{c, m_cursorAttribs});
                 break;
         }
         if(m_cursorX == m_width) {
@@ -134,70 +736,136 @@ public:
         }
     }
 
-    void puts(const std::basic_string<chartype> &s){
+    void puts(std::basic_string_view<chartype> s){
         for(const chartype &c : s) this->putc(c);
     }
     
     void redraw() {
-        attribs cattr = (*this)[0][0].attr;
-        ANSI_COLOR_BG(cattr.bg);
-        ANSI_COLOR_FG(cattr.fg);
+        if(m_offscreen) return;
         for(unsigned y = 0; y < m_height; y++) {
-            ANSI_MOVE(m_x, m_y + y);
-            for(cell c : (*this)[y]) {
-                if(cattr != c.attr) {
-                    cattr = c.attr;
-                    ANSI_COLOR_FG(cattr.fg);
-                    ANSI_COLOR_BG(cattr.bg);
-                }
-                std::cout << c.chr;
-            }
-            std::cout.clear();
+            emitrow(y, 0, m_width, true);
+            m_dirty[y] = dirtyspan{m_width, 0};
         }
         m_back = m_front;
+        m_dirtyY0 = m_height;
+        m_dirtyY1 = 0;
     }
 
+    /*Only the spans written since the last flush are compared and sent*/
     void flush() {
-        attribs currAttr = m_front[0].attr;
-        ANSI_COLOR_FG(currAttr.fg);
-        ANSI_COLOR_BG(currAttr.bg);
-        for(unsigned y = 0; y < m_height; y++) {
-            auto backspan = std::span<cell<chartype>>(
-                    m_back.begin() + (y * m_width),
-                    m_back.begin() + (y * m_width) + m_width);
-            auto frontspan = (*this)[y];
-            bool change = false;
-            if(std::equal(backspan.begin(), backspan.end(), frontspan.begin(), frontspan.end())) continue;
-            for(unsigned x = 0; x < m_width; x++) {
-                cell c = frontspan[x];
-                if(c == backspan[x]) continue;
-                ANSI_MOVE(x + m_x, y + m_y);
-                if(c.attr != currAttr) {
-                    ANSI_COLOR_FG(c.attr.fg);
-                    ANSI_COLOR_BG(c.attr.bg);
-                    currAttr = c.attr;
-                }
-                change = true;
-                std::cout << c.chr;
+        if(m_offscreen) return;
+        for(unsigned y = m_dirtyY0; y < m_dirtyY1; y++) {
+            dirtyspan &span = m_dirty[y];
+            if(span.x0 >= span.x1) continue;
+            emitrow(y, span.x0, span.x1, false);
+            std::copy(m_front.begin() + (y * m_width) + span.x0,
+                      m_front.begin() + (y * m_width) + span.x1,
+                      m_back.begin() + (y * m_width) + span.x0);
+            span = dirtyspan{m_width, 0};
+        }
+        m_dirtyY0 = m_height;
+        m_dirtyY1 = 0;
+    }
+
+    /*Sends the dirty cells inside each region in turn, then the rest, and stops
+     * once about budget bytes are encoded. Cells already sent are synced with
+     * the back buffer, so the spans left dirty only resend what is still stale.
+     * Returns whether everything went out*/
+    bool flush(std::span<const region> regions, std::size_t budget) {
+        if(m_offscreen) return true;
+        std::size_t start = term.pending();
+        auto send = [&](const region &r) {
+            unsigned y1 = std::min({r.y1, m_height, m_dirtyY1});
+            for(unsigned y = std::max(r.y0, m_dirtyY0); y < y1; y++) {
+                if(term.pending() - start >= budget) return false;
+                const dirtyspan &span = m_dirty[y];
+                unsigned x0 = std::max(span.x0, r.x0);
+                unsigned x1 = std::min({span.x1, r.x1, m_width});
+                if(x0 >= x1) continue;
+                emitrow(y, x0, x1, false);
+                std::copy(m_front.begin() + (y * m_width) + x0,
+                          m_front.begin() + (y * m_width) + x1,
+                          m_back.begin() + (y * m_width) + x0);
             }
-            if(change) std::cout.clear();
+            return true;
+        };
+        for(const region &r : regions) {
+            if(!send(r)) return false;
         }
-        m_back = m_front;
+        if(!send(region{0, 0, m_width, m_height})) return false;
+        for(unsigned y = m_dirtyY0; y < m_dirtyY1; y++) m_dirty[y] = dirtyspan{m_width, 0};
+        m_dirtyY0 = m_height;
+        m_dirtyY1 = 0;
+        return true;
     }
 
+    bool dirty() const { return m_dirtyY0 < m_dirtyY1; }
+    bool isoffscreen() const { return m_offscreen; }
+
+    /*Hands each span written since the last drain to fn(y, x0, x1) and forgets it*/
+    template<typename F>
+    void drain(F &&fn) {
+        for(unsigned y = m_dirtyY0; y < m_dirtyY1; y++) {
+            dirtyspan &span = m_dirty[y];
+            if(span.x0 >= span.x1) continue;
+            fn(y, span.x0, span.x1);
+            span = dirtyspan{m_width, 0};
+        }
+        m_dirtyY0 = m_height;
+        m_dirtyY1 = 0;
+    }
+
+    const cell<chartype> *row(unsigned y) const {
+        assert(y < m_height);
+        return m_front.data() + (y * m_width);
+    }
+
+    /*Copies n cells into row y starting at x, marking only the ones that change*/
+    void blit(unsigned x, unsigned y, const cell<chartype> *src, unsigned n) {
+        assert(x + n <= m_width && y < m_height);
+        cell<chartype> *dst = m_front.data() + (y * m_width) + x;
+        unsigned first = mismatch(dst, src, 0, n);
+        if(first == n) return;
+        unsigned last = n;
+        while(last > first && dst[last - 1] == src[last - 1]) last--;
+        std::copy(src + first, src + last, dst + first);
+        touch(y, x + first, x + last);
+    }
+
+    /*Rows handed out for writing are assumed changed in full*/
     std::span<cell<chartype>> operator[](std::size_t i) { 
-        assert(i < m_width * m_height);
+        assert(i < m_height);
+        touch((unsigned)i, 0, m_width);
         return std::span<cell<chartype>>(
                 m_front.begin() + (i * m_width),
                 m_front.begin() + (i * m_width) + m_width);
     }
 
+    /*Text goes straight into the cells. Numbers are formatted into a scratch
+     * buffer the way a stream would print them, anything else falls back to one*/
     template<typename T>
         requires(!std::is_base_of<screen_command_base, T>::value)
     friend screen &operator<<(screen &o, const T &rhs) {
-        std::basic_stringstream<chartype> ss;
-        ss << rhs;
-        o.puts(ss.str());
+        if constexpr(std::is_convertible_v<const T &, std::basic_string_view<chartype>>) {
+            o.puts(std::basic_string_view<chartype>(rhs));
+        }else if constexpr(std::is_convertible_v<const T &, std::string_view>) {
+            for(char c : std::string_view(rhs)) o.putc((chartype)c);
+        }else if constexpr(is_character<T>) {
+            o.putc((chartype)rhs);
+        }else if constexpr(std::is_arithmetic_v<T>) {
+            char digits[32];
+            std::to_chars_result res;
+            if constexpr(std::is_floating_point_v<T>) {
+                res = std::to_chars(digits, digits + sizeof(digits), rhs, std::chars_format::general, 6);
+            }else{
+                res = std::to_chars(digits, digits + sizeof(digits), (std::conditional_t<std::is_same_v<T, bool>, int, T>)rhs);
+            }
+            for(const char *c = digits; c != res.ptr; c++) o.putc((chartype)*c);
+        }else{
+            std::basic_stringstream<chartype> ss;
+            ss << rhs;
+            o.puts(ss.str());
+        }
         return o;
     }
 
@@ -205,12 +873,91 @@ private:
     unsigned m_x{}, m_y{};
     unsigned m_width{}, m_height{};
 
+    struct dirtyspan {
+        unsigned x0, x1;
+    };
+
+    /*First cell in [x, x1) where a and b differ, skipping equal blocks with a wide compare*/
+    static unsigned mismatch(const cell<chartype> *a, const cell<chartype> *b, unsigned x, unsigned x1) {
+        if constexpr(std::has_unique_object_representations_v<cell<chartype>>) {
+            constexpr unsigned block = 8;
+            while(x + block <= x1 && std::memcmp(a + x, b + x, block * sizeof(cell<chartype>)) == 0) x += block;
+        }
+        while(x < x1 && a[x] == b[x]) x++;
+        return x;
+    }
+
+    void touch(unsigned y, unsigned x0, unsigned x1) {
+        dirtyspan &span = m_dirty[y];
+        span.x0 = std::min(span.x0, x0);
+        span.x1 = std::max(span.x1, x1);
+        m_dirtyY0 = std::min(m_dirtyY0, y);
+        m_dirtyY1 = std::max(m_dirtyY1, y + 1);
+    }
+
+    void setcell(unsigned x, unsigned y, const cell<chartype> &c) {
+        cell<chartype> &dst = m_front[x + (y * m_width)];
+        if(dst == c) return;
+        dst = c;
+        touch(y, x, x + 1);
+    }
+
+    /*Fills [x0, x1) of row y, marking only the cells that actually change*/
+    void fill(unsigned y, unsigned x0, unsigned x1, const cell<chartype> &c) {
+        cell<chartype> *row = m_front.data() + (y * m_width);
+        unsigned first = x1, last = x0;
+        for(unsigned x = x0; x < x1; x++) {
+            if(row[x] == c) continue;
+            row[x] = c;
+            first = std::min(first, x);
+            last = x + 1;
+        }
+        if(first < last) touch(y, first, last);
+    }
+
+    /*Sends the cells of row y in [x0, x1) that differ from what the terminal shows*/
+    void emitrow(unsigned y, unsigned x0, unsigned x1, bool all) {
+        cell<chartype> *front = m_front.data() + (y * m_width);
+        cell<chartype> *back = m_back.data() + (y * m_width);
+        unsigned ty = m_y + y;
+        for(unsigned x = x0; x < x1;) {
+            if(!all) {
+                x = mismatch(front, back, x, x1);
+                if(x == x1) break;
+            }
+
+            //Rewriting a short gap of unchanged cells can be cheaper than moving over it
+            unsigned cx;
+            bool rewrite = term.onrow(ty, cx) && cx >= m_x && cx < m_x + x &&
+                (m_x + x) - cx <= term.movecost(m_x + x, ty);
+            for(unsigned i = cx - m_x; rewrite && i < x; i++) rewrite = term.hasattr(front[i].attr);
+            if(rewrite) {
+                for(unsigned i = cx - m_x; i < x; i++) term.putc(front[i].chr);
+            }else{
+                term.moveto(m_x + x, ty);
+            }
+            term.setattr(front[x].attr);
+
+            //Runs of one cell are sent once and repeated, up to the last that changed
+            unsigned run = x + 1;
+            while(run < x1 && front[run] == front[x]) run++;
+            if(!all) while(run > x + 1 && front[run - 1] == back[run - 1]) run--;
+            term.putc(front[x].chr);
+            term.repeat(front[x].chr, run - x - 1);
+            x = run;
+        }
+    }
+
     std::vector<cell<chartype>> m_front;
     std::vector<cell<chartype>> m_back;
+    std::vector<dirtyspan> m_dirty;
+    unsigned m_dirtyY0, m_dirtyY1;
     
     unsigned m_cursorX{}, m_cursorY{};
     attribs m_cursorAttribs;
     chartype m_fillChar;
+    bool m_offscreen{};
+    int m_scrolled{};
 };
 
 struct screen_command_flush : public screen_command_base {
@@ -4,8 +4,12 @@
 #include "ecs.hpp"
 #include "camera.hpp"
 #include "window.hpp"
+#include "spatial.hpp"
+#include "orbit.hpp"
 
 #include <list>
+#include <span>
+#include <limits>
 
 class System {
 private:
@@ -13,27 +17,91 @@ private:
     struct SystemTreeNode {
         int entityId;
         std::list<SystemTreeNode> children;
+        SystemTreeNode *parent = nullptr;
+
+        //Radius around this body containing every orbit below it
+        long bound = 0;
+        //Time the body's position was last evaluated at
+        long epoch = std::numeric_limits<long>::min();
+        //Subtree is evaluated each turn and present in m_index
+        bool active = false;
     };
     SystemTreeNode m_systemTree;
+    std::vector<SystemTreeNode*> m_treeNodes;
     ecs::EntityMan m_entityMan;
+    spatial::QuadTree m_index;
+    unsigned m_maxRadius;
+    //Bodies from the largest radius down
+    std::vector<unsigned> m_bySize;
+
+    std::vector<shapes::rectangle<long>> m_frusta;
+    long m_lastTick;
 
     void addOrbital(const std::string &name, const std::string &orbitingName, unsigned long a, double e, unit::Mass m, unsigned r, double M, double w);
-    void tickOrbitals(unit::Time time);
+    long computeBounds(SystemTreeNode &node);
+
+    void tickOrbital(ecs::Entity &e, unit::Time time);
+    void evaluate(SystemTreeNode &node, unit::Time time);
+    bool sweepVisible(const vex::vec2<long> &origin, const SystemTreeNode &node);
+    void cullSubtree(SystemTreeNode &node, unit::Time time);
+    void deactivate(SystemTreeNode &node);
 
     SystemTreeNode *traverseSystemTree(SystemTreeNode &node, const std::string &name);
     SystemTreeNode *getNode(const std::string &name);
 public:
+    /*Region of interest, relative to the position of the focused body*/
+    struct View {
+        int focus;
+        shapes::rectangle<long> frustum;
+    };
+
     System(const std::string &name);
 
-    void update();
+    void update(std::span<const View> views);
 
     ecs::Entity &getBody(std::size_t id);
 };
 
 class SystemView {
+public:
+    /*A camera drawing into a window, centred on the body it follows. The
+     * first viewport is the main view, the others are insets shown only
+     * while they follow something*/
+    struct Viewport {
+        Camera *camera;
+        std::string window;
+        System::SystemTreeNode *focus;
+    };
 private:
     System *m_system;
-    System::SystemTreeNode *m_focus;
+    std::vector<Viewport> m_viewports;
+    std::vector<System::View> m_views;
+    System::SystemTreeNode *&focus() { return m_viewports.front().focus; }
+    void follow(Viewport &viewport, System::SystemTreeNode *node);
+    //Orbit paths keyed by body and the power of two scale they were sampled for,
+    //with the batched frame that last used each
+    struct CachedPath {
+        orbit::Path path;
+        unsigned used;
+    };
+    std::unordered_map<std::uint64_t, CachedPath> m_orbitPaths;
+    unsigned m_orbitFrame{};
+
+    //Visible orbits waiting for a share of the segment budget, by priority
+    std::vector<std::pair<double, unsigned>> m_orbitQueue;
+    bool m_showOrbits;
+
+    const orbit::Path &orbitPath(unsigned id, long scale);
+    std::size_t batchOrbit(Camera *camera, std::span<const shapes::rectangle<long>> views, unsigned id, long scale,
+                           straw::color color, char c, int layer, std::size_t budget);
+    void batchView(const Viewport &viewport);
+    void batchBodies(Camera *camera, const shapes::rectangle<long> &view, unsigned focus);
+    void batchDensity(Camera *camera, const shapes::rectangle<long> &view);
+
+    //Bodies smaller than a cell, counted per cell, and one of them to pick
+    std::vector<std::uint32_t> m_density;
+    std::vector<std::uint32_t> m_densityPick;
+    void queueOrbits(Camera *camera, System::SystemTreeNode &node);
 
     class Search {
     private:
@@ -66,12 +134,15 @@ private:
     };
     std::unique_ptr<Search> m_focusSearch;
 public:
-    SystemView(System *system) : m_system(system), m_focusSearch(nullptr) {}
+    SystemView(System *system) : m_system(system), m_showOrbits(false), m_focusSearch(nullptr) {}
+
+    void addViewport(Camera *camera, const std::string &window);
 
-    void keypress(Camera *camera, int key);
-    void update(Camera *camera);
-    void draw(Camera *camera);
-    void drawOver(Camera *camera);
+    void keypress(int key);
+    void update();
+    void draw();
+    void render();
+    void drawOver();
 
     void view(System *system);
 
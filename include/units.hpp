@@ -135,6 +135,57 @@ public:
      *  %s = second
      * */
     std::string format(const char *fmt);
+    /*Writes straight into anything with operator<<, such as a window*/
+    template<typename Out>
+    Out &format(Out &out, const char *fmt) {
+        for(; *fmt; fmt++) {
+            if(*fmt != '%') {
+                out << *fmt;
+                continue;
+            }
+            fmt++;
+            switch(*fmt) {
+                case '%':
+                    out << '%';
+                    break;
+                case 'Y':
+                    out << real_years();
+                    break;
+                case 'C':
+                    out << years();
+                    break;
+                case 'S': {
+                    Time year = current_year();
+                    out << month_str[year.months()];
+                    break; }
+                case 'M': {
+                    Time year = current_year();
+                    out << year.months();
+                    break; }
+                case 'W': {
+                    Time month = current_month();
+                    out << month.weeks();
+                    break; }
+                case 'D': {
+                    Time month = current_month();
+                    out << month.days();
+                    break; }
+                case 'H': {
+                    Time day = current_day();
+                    out << day.hours();
+                    break; }
+                case 'm': {
+                    Time hour = current_hour();
+                    out << hour.minutes();
+                    break; }
+                case 's': {
+                    Time minute = current_minute();
+                    out << minute.seconds();
+                    break; }
+            }
+        }
+        return out;
+    }
 };
 
 constexpr long Mm = 1000;
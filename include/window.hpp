@@ -5,16 +5,20 @@
 #include "straw.hpp"
 #include <memory>
 #include <unordered_map>
+#include <vector>
+#include <cstdint>
 
-//Wrapper for screens that act like windows
+//Wrapper for screens that act like windows. Both screens are offscreen,
+//the owning WindowContext composes them onto the terminal
 class Window {
     straw::screen<screenchr> m_border;
     straw::screen<screenchr> m_screen;
     std::string m_title;
     bool m_hidden;
+    unsigned m_hotY0{}, m_hotY1{};
 public:
     explicit Window(const std::string Title, unsigned X, unsigned Y, unsigned W, unsigned H, bool hidden = false) :
-        m_border(X, Y, W, 1), m_screen(X, Y+1, W, H-1), m_title(Title), m_hidden(hidden) {}
+        m_border(straw::offscreen, X, Y, W, 1), m_screen(straw::offscreen, X, Y+1, W, H-1), m_title(Title), m_hidden(hidden) {}
     ~Window() = default;
 
     template<typename T>
@@ -24,27 +28,62 @@ public:
     }
     
     straw::screen<screenchr> *screen() { return &m_screen; }
+    straw::screen<screenchr> *border() { return &m_border; }
     std::string title() const { return m_title; }
 
+    unsigned getx() { return m_border.getx(); }
+    unsigned gety() { return m_border.gety(); }
+    unsigned getwidth() { return m_border.getwidth(); }
+    unsigned getheight() { return m_screen.getheight() + 1; }
+    //Cell at terminal position (x, y), which must lie inside the window
+    const straw::cell<screenchr> &at(unsigned x, unsigned y) {
+        if(y == m_border.gety()) return m_border.row(0)[x - m_border.getx()];
+        return m_screen.row(y - m_screen.gety())[x - m_screen.getx()];
+    }
+
     void draw(bool focus);
 
     void setHidden(bool mode) { m_hidden = mode; }
     bool hidden() const { return m_hidden; }
+
+    //Content rows sent ahead of the rest of the screen when output is limited
+    void setHotspot(unsigned y0, unsigned y1) { m_hotY0 = y0; m_hotY1 = y1; }
+    straw::region hotspot() {
+        return straw::region{getx(), m_screen.gety() + m_hotY0, getx() + getwidth(), m_screen.gety() + m_hotY1};
+    }
 };
 
 #define WINDOW_TITLE_ID "Title"
 #define WINDOW_SYSTEMVIEW_ID "Systemview"
 #define WINDOW_SYSTEMVIEW_SEARCH_ID "SystemviewSearch"
+#define WINDOW_SYSTEMVIEW_INSET_ID "SystemviewInset"
 #define WINDOW_BODYINFO_ID "Bodyinfo"
 #define WINDOW_EVENTS_ID "Events"
 #define WINDOW_TIMEMAN_ID "Timeman"
 
+/*Windows stack in registration order, later ones on top. Every terminal cell
+ * belongs to the topmost visible window over it, and only that window's
+ * writes reach the framebuffer, which is diffed and flushed once a frame*/
 class WindowContext {
+    static constexpr std::uint8_t NO_OWNER = 0xFF;
+
     std::unordered_map<std::string, Window> m_windows;
     std::vector<std::string> m_windowOrder;
     unsigned m_focus;
+    straw::screen<screenchr> m_frame;
+    std::vector<std::uint8_t> m_owner;
+
+    std::vector<straw::region> m_priorities;
+    //Frames in a row the budget cut short, and how many pass before the order rotates
+    unsigned m_deferred;
+    static constexpr unsigned DEFER_FRAMES = 8;
+
+    void compose(std::uint8_t index, straw::screen<screenchr> &canvas);
+    bool owns(std::uint8_t index, unsigned x0, unsigned y0, unsigned x1, unsigned y1) const;
+    void restack();
+    void prioritize();
 public:
-    WindowContext() : m_focus(0) {}
+    WindowContext(unsigned w, unsigned h) : m_focus(0), m_frame(0, 0, w, h), m_owner(w * h, NO_OWNER), m_deferred(0) {}
     ~WindowContext() {}
 
     void registerWindow(const std::string &id, 
@@ -63,6 +102,9 @@ public:
     void setWindowHidden(const std::string &id, bool mode);
     void focus(const std::string &id);
 
+    /*Id of the window showing at terminal cell (x, y), empty where there is none*/
+    std::string windowAt(unsigned x, unsigned y) const;
+
     unsigned getFocused() { return m_focus; }
     std::string getFocusedString() { return m_windowOrder[m_focus]; }
 };
@@ -0,0 +1,78 @@
+#ifndef WORKERS_HPP
+#define WORKERS_HPP 1
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <cstddef>
+
+namespace workers {
+
+/*Fixed set of threads that split one job at a time between them and the
+ * caller. Threads start on the first job that can use them*/
+class Pool {
+    std::vector<std::thread> m_threads;
+    unsigned m_count;
+
+    std::mutex m_lock;
+    std::condition_variable m_wake, m_done;
+    std::function<void(std::size_t)> m_job;
+    std::size_t m_size{};
+    std::atomic<std::size_t> m_next{};
+    unsigned long m_generation{};
+    unsigned m_active{};
+    bool m_stopping{};
+
+    //Set on threads running a job, which could not wait on one of their own
+    inline static thread_local bool s_working = false;
+
+    void work();
+    void loop();
+public:
+    /*Extra threads besides the caller, by default one per remaining core*/
+    explicit Pool(unsigned count);
+    Pool();
+    ~Pool();
+
+    Pool(const Pool &) = delete;
+    Pool &operator=(const Pool &) = delete;
+
+    /*Threads a job is spread over, the caller included*/
+    unsigned size() const { return m_count + 1; }
+
+    /*Calls fn(i) for every i in [0, n) and returns once all of them are done.
+     * Calls run concurrently, so each must only touch what belongs to its i.
+     * A job started from inside another runs on the calling thread*/
+    template<typename F>
+    void run(std::size_t n, F &&fn) {
+        if(m_count == 0 || n <= 1 || s_working) {
+            for(std::size_t i = 0; i < n; i++) fn(i);
+            return;
+        }
+        {
+            std::lock_guard lock(m_lock);
+            if(m_threads.empty()) {
+                for(unsigned i = 0; i < m_count; i++) m_threads.emplace_back(&Pool::loop, this);
+            }
+            m_job = [&fn](std::size_t i) { fn(i); };
+            m_size = n;
+            m_next = 0;
+            m_active = m_count;
+            m_generation++;
+        }
+        m_wake.notify_all();
+        work();
+        std::unique_lock lock(m_lock);
+        m_done.wait(lock, [this]() { return m_active == 0; });
+        m_job = nullptr;
+    }
+};
+
+inline Pool pool;
+
+}
+
+#endif
@@ -1,197 +1,526 @@
 #include "camera.hpp"
 #include "shape.hpp"
+#include "workers.hpp"
 #include <cmath>
 #include <algorithm>
-#include <variant>
-#include <typeinfo>
-#include <any>
+#include <bit>
+#include <cassert>
 
-void 
+void
 Camera::updateFrustum(){
-    if(m_dirty) {
-        *m_viewport << straw::clear(' ');
-        m_frustum = shapes::rectangle<long>(0, 0, (long)m_viewport->getwidth(), (long)m_viewport->getheight());
-        m_frustum.position -= (m_frustum.bounds / 2);
-        m_frustum.position += m_position + m_origin;
-        m_dirty = false;
-    }
+    m_frustum = shapes::rectangle<long>(0, 0, (long)m_viewport->getwidth(), (long)m_viewport->getheight());
+    m_frustum.position -= (m_frustum.bounds / 2);
+    m_frustum.position += m_position + m_origin;
+
+    //The offset is worked out wide, then clamped like any other world coordinate
+    auto offset = [this](unsigned axis) {
+        __int128 off = ((__int128)m_frustum.bounds[axis] * m_scale) / 2 - m_frustum.position[axis];
+        return (long)std::clamp<__int128>(off, -ScreenTransform::WORLD_LIMIT, ScreenTransform::WORLD_LIMIT);
+    };
+    m_transform.scale = m_scale;
+    m_transform.shift = std::has_single_bit((unsigned long)m_scale) ? std::countr_zero((unsigned long)m_scale) : -1;
+    m_transform.offx = offset(0);
+    m_transform.offy = offset(1);
 }
 
+std::uint32_t
+Camera::style(straw::color fg, straw::color bg, char c, int layer)
+{
+    //The key only has a byte for the layer
+    assert(layer >= 0 && layer <= MAX_LAYER);
+    std::uint64_t key = ((std::uint64_t)fg.single() << 40) | ((std::uint64_t)bg.single() << 16) |
+                        ((std::uint64_t)(unsigned char)c << 8) | (std::uint8_t)layer;
+    auto [it, inserted] = m_styleIndex.try_emplace(key, (std::uint32_t)m_styles.size());
+    if(inserted) m_styles.push_back(RenderStyle{fg, bg, c, layer});
+    return it->second;
+}
+
+/*World to screen space for every shape in the batch. Lines carry a second
+ * position, the rest carry extents that only scale*/
 void
-RenderBatchEntry::translate(Camera *camera)
+Camera::transform(ShapeArrays &batch, bool endpoints)
 {
-    std::visit([camera](auto &shapeval) {
-        shapeval.translate(-camera->m_frustum.position);
-        shapeval.translate((camera->m_frustum.bounds * camera->m_scale) / 2);
-        shapeval.position = vex::vec2<long>(
-                (long)std::floor((double)shapeval.position[0] / (double)camera->m_scale),
-                (long)std::floor((double)shapeval.position[1] / (double)camera->m_scale));
-        shapeval.scale(camera->m_scale);
-        }, shape);
+    const ScreenTransform t = m_transform;
+    long limit = endpoints ? LINE_LIMIT : SHAPE_LIMIT;
+    std::size_t n = batch.size();
+    auto each = [n, limit](long *a, long off, auto divide) {
+        for(std::size_t i = 0; i < n; i++) {
+            long v = ScreenTransform::world(a[i]) + off;
+            a[i] = std::clamp(divide(v), -limit, limit);
+        }
+    };
+    auto apply = [&](auto divide) {
+        each(batch.x.data(), t.offx, divide);
+        each(batch.y.data(), t.offy, divide);
+        each(batch.u.data(), endpoints ? t.offx : 0, divide);
+        each(batch.v.data(), endpoints ? t.offy : 0, divide);
+    };
+    if(t.shift >= 0) apply([s = t.shift](long v) { return v >> s; });
+    else apply([&t](long v) { return t.floordiv(v); });
 }
 
-void 
-Camera::draw()
+/*Adds the shapes of one kind that can touch the viewport and the clip to the
+ * draw list. Each test bounds the cells its plot function can write*/
+void
+Camera::cull(ShapeKind kind)
 {
-    if(!m_dirty) return;
-    updateFrustum();
-    shapes::rectangle<long> ssfrustum{vex::vec2<long>(0, 0), vex::vec2<long>(m_viewport->getwidth(), m_viewport->getheight())};
-
-    //Remove all batches not intersecting the screenspace frustum
-    m_shapeBatch.erase(
-            std::remove_if(
-                m_shapeBatch.begin(), 
-                m_shapeBatch.end(),
-                [ssfrustum, this](RenderBatchEntry &entry){
-                    entry.translate(this);
-                    return std::visit([ssfrustum](auto &&shape) {
-                        return shapes::intersects(shape, ssfrustum) == 0;
-                    }, entry.shape);
-                }),
-            m_shapeBatch.end());
-    for(RenderBatchEntry &entry : m_shapeBatch) entry.plot(this);
-    m_shapeBatch.clear();
-}
-
-void
-RenderBatchEntry::plotPoint(shapes::point<long> point, Camera *camera) {
-    long ploty = camera->m_viewport->getheight() - point.position[1];
-    if(point.position[0] < 0 || point.position[0] >= camera->m_viewport->getwidth() ||
-            ploty < 0 || ploty >= camera->m_viewport->getheight()) return;
-    *camera->m_viewport << straw::setcolor(fg, bg) << straw::plot(point.position[0], ploty, c);
-}
-
-void
-RenderBatchEntry::plotLine(shapes::line<long> line, Camera *camera) {
-    if(line.end == line.position) {
-        plotPoint(shapes::point<long>(line.position), camera);
-    }
-    vex::vec2<long> vpdim(camera->m_viewport->getwidth(),
-                          camera->m_viewport->getheight());
-    vex::vec2<long> d(line.end - line.position);
-    long adx = std::abs(d[0]);
-    long ady = std::abs(d[1]);
-
-    long offX= d[0] > 0 ? 1 : -1;
-    long offY = d[1] > 0 ? 1 : -1;
-
-    *camera->m_viewport << straw::setcolor(fg, bg);
-    if(adx < ady) {
-        long err = ady / 2;
-        long x = line.position[0];
-        long y = line.position[1];
-        for(long i = 0; i < ady; i++) {
-            if(x > 0 && x < vpdim[0] && y > 0 && y < vpdim[1]) {
-                long ploty = vpdim[1] - y;
-                *camera->m_viewport << straw::plot(x, ploty, c);
+    ShapeArrays &batch = m_batches[kind];
+    std::size_t n = batch.size();
+    const long *x = batch.x.data(), *y = batch.y.data(), *u = batch.u.data(), *v = batch.v.data();
+    long w = m_raster.width, h = m_raster.height;
+    long cx0 = m_clip.x0, cy0 = m_clip.y0, cx1 = m_clip.x1, cy1 = m_clip.y1;
+    m_visible.resize(n);
+    std::uint8_t *visible = m_visible.data();
+    switch(kind) {
+        case POINT:
+            for(std::size_t i = 0; i < n; i++) {
+                visible[i] = (x[i] > 0) & (x[i] < w) & (y[i] > 0) & (y[i] < h) &
+                             (x[i] >= cx0) & (x[i] < cx1) & (y[i] >= cy0) & (y[i] < cy1);
             }
-            if(err >= ady) {
-                x += offX;
-                y += offY;
-                err += adx - ady;
-            }else {
-                y += offY;
-                err += adx;
+            break;
+        case LINE:
+            for(std::size_t i = 0; i < n; i++) {
+                long lx = std::min(x[i], u[i]), hx = std::max(x[i], u[i]);
+                long ly = std::min(y[i], v[i]), hy = std::max(y[i], v[i]);
+                visible[i] = (hx > 0) & (lx < w) & (hy > 0) & (ly < h) &
+                             (hx >= cx0) & (lx < cx1) & (hy >= cy0) & (ly < cy1);
             }
-        }
+            break;
+        case CIRCLE:
+        case ELLIPSE:
+            for(std::size_t i = 0; i < n; i++) {
+                visible[i] = (x[i] + u[i] >= 0) & (x[i] - u[i] < w) &
+                             (y[i] + v[i] >= 0) & (y[i] - v[i] <= h) &
+                             (x[i] + u[i] >= cx0) & (x[i] - u[i] < cx1) &
+                             (y[i] + v[i] >= cy0) & (y[i] - v[i] < cy1);
+            }
+            break;
+        case RECTANGLE:
+            for(std::size_t i = 0; i < n; i++) {
+                visible[i] = (x[i] <= w) & (x[i] + u[i] >= 0) & (y[i] <= h) & (y[i] + v[i] >= 0) &
+                             (x[i] < cx1) & (x[i] + u[i] > cx0) & (y[i] < cy1) & (y[i] + v[i] > cy0);
+            }
+            break;
+        default: break;
+    }
+    for(std::size_t i = 0; i < n; i++) {
+        if(visible[i]) m_drawList.push_back(DrawItem{(std::uint32_t)i, kind});
+    }
+}
+
+/*Stable counting sort of the draw list by layer, then style*/
+void
+Camera::sortDrawList()
+{
+    std::size_t styles = m_styles.size();
+    //Styles are only ever added, so the ranking changes only when one is
+    std::vector<std::uint32_t> &rank = m_styleRank;
+    if(rank.size() != styles) {
+        rank.resize(styles);
+        for(std::uint32_t i = 0; i < styles; i++) rank[i] = i;
+        std::stable_sort(rank.begin(), rank.end(), [this](std::uint32_t a, std::uint32_t b) {
+            return m_styles[a].layer < m_styles[b].layer;
+        });
+    }
+    std::vector<std::size_t> &start = m_styleStart;
+    start.assign(styles + 1, 0);
+    for(const DrawItem &item : m_drawList) start[m_batches[item.kind].style[item.index]]++;
+    std::size_t offset = 0;
+    for(std::uint32_t r = 0; r < styles; r++) {
+        std::size_t count = start[rank[r]];
+        start[rank[r]] = offset;
+        offset += count;
+    }
+    m_drawOrder.resize(m_drawList.size());
+    for(const DrawItem &item : m_drawList) {
+        m_drawOrder[start[m_batches[item.kind].style[item.index]]++] = item;
+    }
+}
+
+/*Works out this frame's transform and which cells it has to rasterize. A pan
+ * by whole cells moves the last frame over and only draws what it uncovered.
+ * Lines and points never reach the top row or left column, so a frame moved
+ * away from those edges gets them redrawn as well*/
+void
+Camera::plan()
+{
+    updateFrustum();
+    unsigned w = m_raster.width, h = m_raster.height;
+    //Viewport rows [r0, r1) and columns [c0, c1) in the unflipped space the plots work in
+    auto rows = [w, h](unsigned r0, unsigned r1) { return straw::region{0, h - r1 + 1, w, h - r0 + 1}; };
+    auto cols = [h](unsigned c0, unsigned c1) { return straw::region{c0, 1, c1, h + 1}; };
+    m_clips[0] = rows(0, h);
+    m_passes = 1;
+    m_shiftX = m_shiftY = 0;
+    m_reuse = false;
+
+    const ScreenTransform &last = m_drawn;
+    auto exact = [](long off) { return std::abs(off) < ScreenTransform::WORLD_LIMIT; };
+    long dx = m_transform.offx - last.offx, dy = m_transform.offy - last.offy;
+    long cx = dx / m_scale, cy = dy / m_scale;
+    if(m_repaint || !exact(last.offx) || !exact(last.offy) || !exact(m_transform.offx) || !exact(m_transform.offy) ||
+            dx % m_scale != 0 || dy % m_scale != 0 || (cx != 0 && cy != 0) ||
+            std::abs(cx) + 1 >= (long)w || std::abs(cy) + 1 >= (long)h) return;
 
+    m_reuse = true;
+    m_shiftX = (int)cx;
+    m_shiftY = (int)-cy;
+    if(cx > 0) {
+        m_clips[0] = cols(0, (unsigned)cx + 1);
+    }else if(cx < 0) {
+        m_clips[0] = cols(w - (unsigned)-cx, w);
+        m_clips[m_passes++] = cols(0, 1);
+    }else if(cy < 0) {
+        m_clips[0] = rows(0, (unsigned)-cy + 1);
+    }else if(cy > 0) {
+        m_clips[0] = rows(h - (unsigned)cy, h);
+        m_clips[m_passes++] = rows(0, 1);
     }else{
-        long err = adx / 2;
-        long x = line.position[0];
-        long y = line.position[1];
-        for(long i = 0; i < adx; i++) {
-            if(x > 0 && x < vpdim[0] && y > 0 && y < vpdim[1]) {
-                long ploty = vpdim[1] - y;
-                *camera->m_viewport << straw::plot(x, ploty, c);
-            }
-            if(err >= adx) {
-                x += offX;
-                y += offY;
-                err += ady - adx;
-            }else {
-                x += offX;
-                err += ady;
+        m_passes = 0;
+    }
+}
+
+std::span<const shapes::rectangle<long>>
+Camera::getdrawviews()
+{
+    plan();
+    //Inverse of the transform for the cells of each clip
+    for(std::size_t i = 0; i < m_passes; i++) {
+        const straw::region &clip = m_clips[i];
+        m_drawViews[i] = shapes::rectangle<long>(
+                ((long)clip.x0 * m_scale) - m_transform.offx, ((long)clip.y0 * m_scale) - m_transform.offy,
+                (long)(clip.x1 - clip.x0) * m_scale, (long)(clip.y1 - clip.y0) * m_scale);
+    }
+    return std::span<const shapes::rectangle<long>>(m_drawViews.data(), m_passes);
+}
+
+void
+Camera::draw()
+{
+    if(!m_dirty) {
+        for(ShapeArrays &batch : m_batches) batch.clear();
+        return;
+    }
+    plan();
+    unsigned w = m_raster.width, h = m_raster.height;
+    if(m_reuse) {
+        m_raster.shift(m_shiftX, m_shiftY, straw::cell<char>(' '));
+        //Edge lines redrawn in place still hold what was moved onto them
+        for(std::size_t i = 0; i < m_passes; i++) {
+            const straw::region &clip = m_clips[i];
+            for(unsigned y = h + 1 - std::min(clip.y1, h + 1); y < h + 1 - clip.y0; y++) {
+                m_raster.blank(y, clip.x0, clip.x1, straw::cell<char>(' '));
             }
         }
+    }else{
+        m_raster.clear(straw::cell<char>(' '));
     }
+
+    for(unsigned kind = 0; kind < SHAPE_KINDS; kind++) transform(m_batches[kind], kind == LINE);
+    for(std::size_t i = 0; i < m_passes; i++) rasterize(m_clips[i]);
+    //The terminal can move the rows itself, so the viewport follows the raster when that sends less
+    if(m_reuse && m_shiftY != 0 && straw::term.canscroll(m_viewport->getx(), m_viewport->getx() + w) && scrollpays()) {
+        m_viewport->scrollrows(-m_shiftY);
+    }
+    for(unsigned y = 0; y < h; y++) m_viewport->blit(0, y, m_raster.row(y), w);
+
+    for(ShapeArrays &batch : m_batches) batch.clear();
+    m_drawn = m_transform;
+    m_dirty = m_repaint = false;
 }
 
+/*True when fewer cells differ from the raster with the viewport's rows moved
+ * along with it than with them left in place. Rows uncovered count in full*/
+bool
+Camera::scrollpays() const
+{
+    unsigned w = m_raster.width, h = m_raster.height;
+    std::size_t moved = (std::size_t)std::abs(m_shiftY) * w, still = 0;
+    for(unsigned y = 0; y < h; y++) {
+        const straw::cell<char> *row = m_raster.row(y), *here = m_viewport->row(y);
+        long from = (long)y - m_shiftY;
+        const straw::cell<char> *there = from >= 0 && from < (long)h ? m_viewport->row((unsigned)from) : nullptr;
+        for(unsigned x = 0; x < w; x++) {
+            still += !(here[x] == row[x]);
+            if(there != nullptr) moved += !(there[x] == row[x]);
+        }
+    }
+    return moved < still;
+}
+
+/*Draws every batched shape, in layer order, into the cells of clip. The
+ * clip is cut into bands of rows that the pool draws side by side*/
 void
-RenderBatchEntry::plotCircle(shapes::circle<long> circle, Camera *camera) {
-    if(circle.radius == 1) {
-        plotPoint(shapes::point<long>(circle.position), camera);
-        return;
+Camera::rasterize(const straw::region &clip)
+{
+    m_clip = clip;
+    m_drawList.clear();
+    for(unsigned kind = 0; kind < SHAPE_KINDS; kind++) cull((ShapeKind)kind);
+    sortDrawList();
+    binDrawList();
+    m_raster.begin();
+    workers::pool.run(m_tiles.size(), [this](std::size_t i) { drawTile(m_tiles[i]); });
+}
+
+/*Unflipped rows the shape can write, inclusive*/
+void
+Camera::rowSpan(const DrawItem &item, long &lo, long &hi) const
+{
+    const ShapeArrays &batch = m_batches[item.kind];
+    long y = batch.y[item.index], u = batch.u[item.index], v = batch.v[item.index];
+    switch(item.kind) {
+        case LINE: lo = std::min(y, v); hi = std::max(y, v); break;
+        case CIRCLE: lo = y - u; hi = y + u; break;
+        case ELLIPSE: lo = y - v; hi = y + v; break;
+        case RECTANGLE: lo = y; hi = y + v - 1; break;
+        default: lo = hi = y; break;
     }
-    long sy = std::max<long>(1, circle.position[1] - circle.radius);
-    long ey = std::min<long>(camera->m_viewport->getheight(), circle.position[1] + circle.radius);
-    *camera->m_viewport << straw::setcolor(fg, bg);
-    for(long y = sy; y <= ey; y++) {
-        long ploty = camera->m_viewport->getheight() - y;
-        long r2 = circle.radius * circle.radius;
-        long dy = circle.position[1] - y;
-        long dx = (long)std::sqrt(r2 - (dy * dy));
-        long sx = std::max<long>(0, circle.position[0] - dx + 1);
-        long ex = std::min<long>(camera->m_viewport->getwidth(), circle.position[0] + dx);
-        for(unsigned x = (unsigned)sx; x < ex; x++) {
-            *camera->m_viewport << straw::plot(x, ploty, c);
+}
+
+/*Columns the shape can write, inclusive*/
+void
+Camera::colSpan(const DrawItem &item, long &lo, long &hi) const
+{
+    const ShapeArrays &batch = m_batches[item.kind];
+    long x = batch.x[item.index], u = batch.u[item.index];
+    switch(item.kind) {
+        case LINE: lo = std::min(x, u); hi = std::max(x, u); break;
+        case CIRCLE:
+        case ELLIPSE: lo = x - u; hi = x + u; break;
+        case RECTANGLE: lo = x; hi = x + u - 1; break;
+        default: lo = hi = x; break;
+    }
+}
+
+/*Splits the clip into bands and hands each the shapes whose rows reach it,
+ * keeping the draw order*/
+void
+Camera::binDrawList()
+{
+    unsigned h = m_raster.height;
+    unsigned bands = std::clamp(h / TILE_MIN_ROWS, 1u, workers::pool.size() * TILES_PER_THREAD);
+    unsigned rows = (h + bands - 1) / bands;
+    m_tiles.resize(bands);
+    for(unsigned t = 0; t < bands; t++) {
+        //Raster rows [r0, r1) are unflipped rows [h - r1 + 1, h - r0 + 1)
+        unsigned r0 = std::min(t * rows, h), r1 = std::min(r0 + rows, h);
+        Tile &tile = m_tiles[t];
+        tile.clip = m_clip;
+        tile.clip.y0 = std::max(m_clip.y0, h - r1 + 1);
+        tile.clip.y1 = std::min(m_clip.y1, h - r0 + 1);
+        tile.items.clear();
+    }
+
+    for(const DrawItem &item : m_drawOrder) {
+        long lo, hi;
+        rowSpan(item, lo, hi);
+        lo = std::max<long>(lo, 1);
+        hi = std::min<long>(hi, h);
+        if(lo > hi) continue;
+        for(unsigned t = (unsigned)(h - hi) / rows; t <= (unsigned)(h - lo) / rows && t < bands; t++) {
+            Tile &tile = m_tiles[t];
+            if(tile.clip.y0 < tile.clip.y1) tile.items.push_back(item);
         }
     }
 }
 
+/*True when every cell the shape could reach in the tile is already written,
+ * so nothing of it would show in front of what was drawn there*/
+bool
+Camera::covered(const Tile &tile, const DrawItem &item) const
+{
+    long lo, hi, x0, x1;
+    rowSpan(item, lo, hi);
+    colSpan(item, x0, x1);
+    lo = std::max<long>(lo, tile.clip.y0);
+    hi = std::min<long>(hi, (long)tile.clip.y1 - 1);
+    x0 = std::max<long>({x0, 0, tile.clip.x0});
+    x1 = std::min<long>({x1 + 1, m_raster.width, tile.clip.x1});
+    if(x0 >= x1) return true;
+    for(long y = lo; y <= hi; y++) {
+        if(!m_raster.covers(m_raster.height - y, (unsigned)x0, (unsigned)x1)) return false;
+    }
+    return true;
+}
+
+/*Draws the tile's shapes front to back. Each cell keeps the first shape to
+ * reach it, the same one that would have been painted last*/
 void
-RenderBatchEntry::plotRectangle(shapes::rectangle<long> rectangle, Camera *camera)
+Camera::drawTile(const Tile &tile)
 {
-    if(rectangle.bounds[1] == 1) {
-        plotPoint(shapes::point<long>(rectangle.position), camera);
+    const straw::region &clip = tile.clip;
+    for(auto it = tile.items.rbegin(); it != tile.items.rend(); ++it) {
+        const DrawItem &item = *it;
+        if(covered(tile, item)) continue;
+        const ShapeArrays &batch = m_batches[item.kind];
+        std::uint32_t i = item.index;
+        straw::cell<char> cell = m_styles[batch.style[i]].cell();
+        std::uint32_t pick = batch.pick[i];
+        switch(item.kind) {
+            case POINT: plotPoint(clip, batch.x[i], batch.y[i], cell, pick); break;
+            case LINE: plotLine(clip, batch.x[i], batch.y[i], batch.u[i], batch.v[i], cell, pick); break;
+            case CIRCLE: plotCircle(clip, batch.x[i], batch.y[i], batch.u[i], cell, pick); break;
+            case ELLIPSE: plotEllipse(clip, batch.x[i], batch.y[i], batch.u[i], batch.v[i], cell, pick); break;
+            case RECTANGLE: plotRectangle(clip, batch.x[i], batch.y[i], batch.u[i], batch.v[i], cell, pick); break;
+            default: break;
+        }
+    }
+}
+
+void
+Camera::Raster::shift(int dx, int dy, const straw::cell<char> &c)
+{
+    std::vector<straw::cell<char>> moved(cells.size(), c);
+    std::vector<std::uint32_t> movedPicks(picks.size(), NO_PICK);
+    long x0 = std::max(0, dx), x1 = std::min((long)width, (long)width + dx);
+    for(unsigned y = 0; y < height && x0 < x1; y++) {
+        long from = (long)y - dy;
+        if(from < 0 || from >= (long)height) continue;
+        std::size_t src = ((std::size_t)from * width) + (x0 - dx), dst = ((std::size_t)y * width) + x0;
+        std::copy_n(cells.begin() + src, x1 - x0, moved.begin() + dst);
+        std::copy_n(picks.begin() + src, x1 - x0, movedPicks.begin() + dst);
+    }
+    cells.swap(moved);
+    picks.swap(movedPicks);
+}
+
+void
+Camera::plotPoint(const straw::region &clip, long x, long y, const straw::cell<char> &cell, std::uint32_t pick) {
+    long ploty = m_raster.height - y;
+    if(x < 0 || x >= m_raster.width ||
+            ploty < 0 || ploty >= m_raster.height) return;
+    if(x < clip.x0 || x >= clip.x1 || y < clip.y0 || y >= clip.y1) return;
+    m_raster.set((unsigned)x, (unsigned)ploty, cell, pick);
+}
+
+void
+Camera::plotLine(const straw::region &clip, long x0, long y0, long x1, long y1, const straw::cell<char> &cell, std::uint32_t pick) {
+    if(x0 == x1 && y0 == y1) {
+        plotPoint(clip, x0, y0, cell, pick);
         return;
     }
-    long sy = std::max<long>(1, rectangle.position[1]);
-    long ey = std::min<long>(camera->m_viewport->getheight(), rectangle.position[1] + rectangle.bounds[1]);
-    *camera->m_viewport << straw::setcolor(fg, bg);
-    for(long y = sy; y < ey; y++) {
-        long ploty = camera->m_viewport->getheight() - y;
-        long sx = std::max<long>(0, rectangle.position[1]);
-        long ex = std::min<long>(camera->m_viewport->getwidth(), rectangle.position[1] + rectangle.bounds[1]);
-        for(unsigned x = (unsigned)sx; x < ex; x++) {
-            *camera->m_viewport << straw::plot(x, ploty, c);
+    vex::vec2<long> vpdim(m_raster.width,
+                          m_raster.height);
+    //Cells a line may reach, inclusive
+    vex::vec2<long> low(std::max<long>(1, clip.x0), std::max<long>(1, clip.y0));
+    vex::vec2<long> high(std::min<long>(vpdim[0], clip.x1) - 1, std::min<long>(vpdim[1], clip.y1) - 1);
+    vex::vec2<long> d(x1 - x0, y1 - y0);
+
+    //Bresenham along the major axis, one step per cell
+    unsigned major = std::abs(d[0]) < std::abs(d[1]) ? 1 : 0;
+    unsigned minor = major ^ 1;
+    long steps = std::abs(d[major]);
+    long dm = std::abs(d[minor]);
+    long offA = d[major] > 0 ? 1 : -1;
+    long offB = d[minor] > 0 ? 1 : -1;
+    long pa = major == 0 ? x0 : y0;
+    long pb = major == 0 ? y0 : x0;
+    long lowA = low[major], highA = high[major];
+    long lowB = low[minor], highB = high[minor];
+
+    //Minor axis steps taken before step i. Closed form of the error term, so
+    //the walk can start at the first visible step
+    auto minorSteps = [&](long i) -> long {
+        if(i == 0) return 0;
+        return (long)(((__int128)steps / 2 + (__int128)(i - 1) * dm) / steps);
+    };
+    auto minorAt = [&](long i) { return pb + offB * minorSteps(i); };
+
+    //Clip to the steps whose major coordinate lies in [lowA, highA]
+    long lo = offA > 0 ? lowA - pa : pa - highA;
+    long hi = offA > 0 ? highA - pa : pa - lowA;
+    lo = std::max(lo, 0L);
+    hi = std::min(hi, steps - 1);
+    if(lo > hi) return;
+
+    //The minor coordinate is monotonic, so the visible steps form one range
+    auto firstWhere = [&](long from, long to, auto pred) {
+        while(from < to) {
+            long mid = from + (to - from) / 2;
+            if(pred(mid)) to = mid;
+            else from = mid + 1;
+        }
+        return from;
+    };
+    long first = firstWhere(lo, hi + 1, [&](long i) {
+        long b = minorAt(i);
+        return offB > 0 ? b >= lowB : b <= highB;
+    });
+    long last = firstWhere(first, hi + 1, [&](long i) {
+        long b = minorAt(i);
+        return offB > 0 ? b > highB : b < lowB;
+    });
+
+    long taken = minorSteps(first);
+    long err = (long)((__int128)steps / 2 + (__int128)first * dm - (__int128)taken * steps);
+    long pos[2];
+    pos[major] = pa + offA * first;
+    pos[minor] = pb + offB * taken;
+    for(long i = first; i < last; i++) {
+        m_raster.set((unsigned)pos[0], (unsigned)(vpdim[1] - pos[1]), cell, pick);
+        if(err >= steps) {
+            pos[minor] += offB;
+            err += dm - steps;
+        }else{
+            err += dm;
         }
+        pos[major] += offA;
     }
 }
 
 void
-RenderBatchEntry::plotEllipse(shapes::ellipse<long> shapeval, Camera *camera) {
-    if(shapeval.a == 1) {
-        plotPoint(shapes::point<long>(shapeval.position), camera);
+Camera::plotCircle(const straw::region &clip, long cx, long cy, long radius, const straw::cell<char> &cell, std::uint32_t pick) {
+    if(radius == 1) {
+        plotPoint(clip, cx, cy, cell, pick);
         return;
     }
-    long sy = std::max<long>(1, shapeval.position[1] - shapeval.b);
-    long ey = std::min<long>(camera->m_viewport->getheight(), shapeval.position[1] + shapeval.b);
-    *camera->m_viewport << straw::setcolor(fg, bg);
+    long sy = std::max<long>({1, cy - radius, clip.y0});
+    long ey = std::min<long>({m_raster.height, cy + radius, (long)clip.y1 - 1});
     for(long y = sy; y <= ey; y++) {
-        long ploty = camera->m_viewport->getheight() - y;
-        long dy = shapeval.position[1] - y;
-        long dy2 = dy * dy;
-        long a2 = shapeval.a * shapeval.a;
-        long b2 = shapeval.b * shapeval.b;
-        long dx = (long)(((2.0 * (double)shapeval.a) /
-                    (double)shapeval.b) * std::sqrt(b2 - dy2) / 2.0);
-        long sx = std::max<long>(0, shapeval.position[0] - dx + 1);
-        long ex = std::min<long>(camera->m_viewport->getwidth(), shapeval.position[0] + dx);
-
-        for(unsigned x = (unsigned)sx; x < ex; x++) {
-            *camera->m_viewport << straw::plot(x, ploty, c);
-        }       
+        long ploty = m_raster.height - y;
+        long r2 = radius * radius;
+        long dy = cy - y;
+        long dx = (long)std::sqrt(r2 - (dy * dy));
+        long sx = std::max<long>({0, cx - dx + 1, clip.x0});
+        long ex = std::min<long>({m_raster.width, cx + dx, clip.x1});
+        if(sx < ex) m_raster.fill((unsigned)ploty, (unsigned)sx, (unsigned)ex, cell, pick);
     }
 }
+
 void
-RenderBatchEntry::plot(Camera *camera) 
+Camera::plotRectangle(const straw::region &clip, long rx, long ry, long rw, long rh, const straw::cell<char> &cell, std::uint32_t pick)
 {
-    std::visit([this, camera](auto &shapeval) -> void{
-        using T = std::decay_t<decltype(shapeval)>;
-        if constexpr(std::is_same_v<T, shapes::point<long>>) plotPoint(shapeval, camera);
-        if constexpr(std::is_same_v<T, shapes::line<long>>) plotLine(shapeval, camera);
-        if constexpr(std::is_same_v<T, shapes::ellipse<long>>) plotEllipse(shapeval, camera);
-        if constexpr(std::is_same_v<T, shapes::circle<long>>) plotCircle(shapeval, camera);
-        if constexpr(std::is_same_v<T, shapes::rectangle<long>>) plotRectangle(shapeval, camera);
-    }, shape);
+    if(rh == 1) {
+        plotPoint(clip, rx, ry, cell, pick);
+        return;
+    }
+    long sy = std::max<long>({1, ry, clip.y0});
+    long ey = std::min<long>({m_raster.height, ry + rh, clip.y1});
+    for(long y = sy; y < ey; y++) {
+        long ploty = m_raster.height - y;
+        long sx = std::max<long>({0, rx, clip.x0});
+        long ex = std::min<long>({m_raster.width, rx + rw, clip.x1});
+        if(sx < ex) m_raster.fill((unsigned)ploty, (unsigned)sx, (unsigned)ex, cell, pick);
+    }
+}
+
+void
+Camera::plotEllipse(const straw::region &clip, long cx, long cy, long a, long b, const straw::cell<char> &cell, std::uint32_t pick) {
+    if(a == 1) {
+        plotPoint(clip, cx, cy, cell, pick);
+        return;
+    }
+    long sy = std::max<long>({1, cy - b, clip.y0});
+    long ey = std::min<long>({m_raster.height, cy + b, (long)clip.y1 - 1});
+    for(long y = sy; y <= ey; y++) {
+        long ploty = m_raster.height - y;
+        long dy = cy - y;
+        long dy2 = dy * dy;
+        long b2 = b * b;
+        long dx = (long)(((2.0 * (double)a) /
+                    (double)b) * std::sqrt(b2 - dy2) / 2.0);
+        long sx = std::max<long>({0, cx - dx + 1, clip.x0});
+        long ex = std::min<long>({m_raster.width, cx + dx, clip.x1});
+        if(sx < ex) m_raster.fill((unsigned)ploty, (unsigned)sx, (unsigned)ex, cell, pick);
+    }
 }
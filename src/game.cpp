@@ -3,6 +3,8 @@
 #include "input.hpp"
 #include <thread>
 #include <chrono>
+#include <cstdlib>
+#include <string_view>
 
 constexpr static double REQUESTED_FPS = 60.0;
 constexpr static double REQ_FPS_MSPT = 1000.0 / REQUESTED_FPS;
@@ -10,7 +12,7 @@ constexpr static double REQ_FPS_MSPT = 1000.0 / REQUESTED_FPS;
 std::unordered_map<std::string, WindowContext> Game::m_contexts;
 std::string Game::m_currentContext;
 
-std::unique_ptr<Camera> Game::m_camera;
+std::vector<std::unique_ptr<Camera>> Game::m_cameras;
 std::unique_ptr<System> Game::m_system;
 SystemView Game::m_systemView(nullptr);
 
@@ -35,17 +37,27 @@ Game::setup(unsigned w, unsigned h, const std::string &sysname)
     unsigned int timeh = h - infoh;
 
     TimeMan::init();
-    m_contexts.emplace(WINCTX_GAME, WindowContext());
-    m_contexts.emplace(WINCTX_TITLE, WindowContext());
-    WindowContext *gameContext = &m_contexts[WINCTX_GAME];
+    straw::term.resize(w, h);
+    straw::term.probe(STDIN_FILENO);
+    straw::term.setmouse(true);
+    if(const char *term = std::getenv("TERM"); term != nullptr && std::string_view(term) == "linux") {
+        straw::term.setrep(false);
+    }
+    m_contexts.emplace(WINCTX_GAME, WindowContext(w, h));
+    m_contexts.emplace(WINCTX_TITLE, WindowContext(w, h));
+    WindowContext *gameContext = &m_contexts.at(WINCTX_GAME);
 
     gameContext->registerWindow(WINDOW_SYSTEMVIEW_ID, "System View", infow, 0, w - infow, viewh);
     gameContext->registerWindow(WINDOW_BODYINFO_ID, "Body Info", 0, 0, infow, infoh);
     gameContext->registerWindow(WINDOW_TIMEMAN_ID, "Time", 0, viewh - timeh, infow, timeh);
+    gameContext->registerWindow(WINDOW_SYSTEMVIEW_INSET_ID, "Following", w - ((w - infow) / 3), 0, (w - infow) / 3, viewh / 3, true);
     gameContext->registerWindow(WINDOW_SYSTEMVIEW_SEARCH_ID, "Search", infow, 0, (w - infow) / 4, viewh, true);
     m_currentContext = WINCTX_GAME;
 
-    m_camera = std::make_unique<Camera>((*gameContext)[WINDOW_SYSTEMVIEW_ID].screen());
+    for(const char *window : {WINDOW_SYSTEMVIEW_ID, WINDOW_SYSTEMVIEW_INSET_ID}) {
+        m_cameras.push_back(std::make_unique<Camera>((*gameContext)[window].screen()));
+        m_systemView.addViewport(m_cameras.back().get(), window);
+    }
     m_system = std::make_unique<System>(sysname);
     m_systemView.view(m_system.get());
 
@@ -62,6 +74,8 @@ Game::setup(unsigned w, unsigned h, const std::string &sysname)
     KeyMan::registerBind('-', BIND_SYSTEMVIEW_INCSCALE, CTX_SYSTEMVIEW, "Decreases zoom from center of screen");
     KeyMan::registerBind('+', BIND_SYSTEMVIEW_DECSCALE, CTX_SYSTEMVIEW, "Increases zoom into center of screen");
     KeyMan::registerBind('/', BIND_SYSTEMVIEW_SEARCH, CTX_SYSTEMVIEW, "Search through bodies in the system");
+    KeyMan::registerBind('o', BIND_SYSTEMVIEW_ORBITS, CTX_SYSTEMVIEW, "Toggle orbit paths for every visible body");
+    KeyMan::registerBind('f', BIND_SYSTEMVIEW_FOLLOW, CTX_SYSTEMVIEW, "Follow the focused body in an inset view, or close its inset");
 
     KeyMan::registerBind(input::CTRL_KEY_ARROWUP, BIND_SYSTEMVIEW_SEARCH_PREV, CTX_SYSTEMVIEW, "Move the cursor up in the search view");
     KeyMan::registerBind(input::CTRL_KEY_ARROWDOWN, BIND_SYSTEMVIEW_SEARCH_NEXT, CTX_SYSTEMVIEW, "Move the cursor down in the search view");
@@ -73,6 +87,9 @@ Game::setup(unsigned w, unsigned h, const std::string &sysname)
 void
 Game::cleanup()
 {
+    straw::term.setmouse(false);
+    straw::term.present();
+    straw::term.finish();
     KeyMan::writeKeybindsTo("keybinds.csv");
 }
 
@@ -91,21 +108,21 @@ Game::turn()
     }
 
     if(m_currentContext == WINCTX_GAME) { /*Game Context*/
-        m_systemView.keypress(m_camera.get(), c);
+        m_systemView.keypress(c);
         
-        m_system->update();
-        m_systemView.update(m_camera.get());
+        m_systemView.update();
         TimeMan::update(c); 
         if(TimeMan::changed()) {
-            m_camera->markDirty();
+            for(auto &camera : m_cameras) camera->markDirty();
         }
 
-        m_systemView.draw(m_camera.get());
+        m_systemView.draw();
         TimeMan::draw();
-        m_camera->draw();
-        m_systemView.drawOver(m_camera.get());
+        m_systemView.render();
+        m_systemView.drawOver();
         context.draw();
     }
+    straw::term.present();
 
     std::this_thread::sleep_until(end);
     end = std::chrono::steady_clock::now();
@@ -1,15 +1,53 @@
+#include <string>
+#include <cstdio>
 #include "input.hpp"
 namespace input {
 
+static MouseEvent mouse{};
+
+//Body of a mouse report still arriving, kept between calls
+static std::string report;
+static bool reporting = false;
+static constexpr std::size_t REPORT_MAX = 32;
+
+/*SGR report, ESC [ < button ; x ; y then M for a press or m for a release.
+ * A report split across reads is finished on later calls, so its tail is
+ * never taken for keys. One that does not parse is dropped whole*/
+static int readmouse() {
+    reporting = true;
+    char c;
+    while(read(STDIN_FILENO, &c, 1) == 1) {
+        if(c != 'M' && c != 'm') {
+            if(report.size() < REPORT_MAX) report.push_back(c);
+            continue;
+        }
+        reporting = false;
+        unsigned b, x, y;
+        char tail;
+        bool valid = std::sscanf(report.c_str(), "%u;%u;%u%c", &b, &x, &y, &tail) == 3;
+        report.clear();
+        if(!valid) return -1;
+        mouse = MouseEvent{b, x > 0 ? x - 1 : 0, y > 0 ? y - 1 : 0, c == 'M'};
+        return CTRL_KEY_MOUSE;
+    }
+    return -1;
+}
+
+const MouseEvent &getmouse() {
+    return mouse;
+}
+
 int getcode() {
     int r = 0;
     char c;
+    if(reporting) return readmouse();
     if(read(STDIN_FILENO, &c, 1) != 1) return -1;
     if(c == '\x1b') {
         char seq[3];
         if(read(STDIN_FILENO, &seq[0], 1) != 1) return '\x1b';
         if(read(STDIN_FILENO, &seq[1], 1) != 1) return '\x1b';
         if(seq[0] == '[') {
+            if(seq[1] == '<') return readmouse();
             if(seq[1] >= 0 && seq[1] <= '9') {
                 if(read(STDIN_FILENO, &seq[2], 1) != 1) return '\x1b';
                 if(seq[2] == '~') {
@@ -1,4 +1,5 @@
 #include <iostream>
+#include <cstdlib>
 #include "game.hpp"
 #include "diargs.hpp"
 
@@ -12,7 +13,15 @@ printusage(int err)
     std::cout << "systemviewer " << VERSION << std::endl << 
         "Usage: systemviewer [OPTION]... [FILE]" << std::endl << 
         "With no FILE, FILE is assumed to be data/sol.csv" << std::endl <<
-        "-h --help : print this message" << std::endl;
+        "-h --help : print this message" << std::endl <<
+        "-c --colors MODE : color depth, one of truecolor, 256 or 16" << std::endl <<
+        "                   (default taken from COLORTERM and TERM)" << std::endl <<
+        "-b --budget BYTES : most bytes sent per frame, the rest follows later" << std::endl <<
+        "                    (default 0, no limit)" << std::endl <<
+        "-m --margins : scroll windows with left/right margins (DECLRMM)" << std::endl <<
+        "               (default on when the terminal reports support)" << std::endl <<
+        "-s --sync : send each frame as one synchronized update (DEC 2026)" << std::endl <<
+        "            (default on when the terminal reports support)" << std::endl;
 
     std::exit(err);
 }
@@ -21,17 +30,32 @@ int
 main(int argc, char **argv)
 {
     std::string system = "dat/sol.csv";
-    bool helpflag;
+    std::string colors;
+    std::size_t budget = 0;
+    bool margins = false;
+    bool sync = false;
+    bool helpflag = false;
 
     diargs::ArgsPair args{argc, argv};
     diargs::ArgumentList arglist(
         diargs::OrderedArgument<std::string>(system),
-        diargs::ToggleArgument<bool>("help", 'h', helpflag, true)
+        diargs::ToggleArgument<bool>("help", 'h', helpflag, true),
+        diargs::MultiArgument<std::string>("colors", 'c', colors),
+        diargs::MultiArgument<std::size_t>("budget", 'b', budget),
+        diargs::ToggleArgument<bool>("margins", 'm', margins, true),
+        diargs::ToggleArgument<bool>("sync", 's', sync, true)
             );
     diargs::ArgumentParser(printusage, arglist, args);
 
     if(helpflag) printusage(0);
 
+    straw::colormode colormode = straw::detectcolormode(std::getenv("COLORTERM"), std::getenv("TERM"));
+    if(!colors.empty() && !straw::parsecolormode(colors, colormode)) printusage(-1);
+    straw::term.setcolormode(colormode);
+    straw::term.setframebudget(budget);
+    straw::term.setmargins(margins);
+    straw::term.setsync(sync);
+
     struct winsize w;
     ioctl(STDOUT_FILENO, TIOCGWINSZ, &w);
     fcntl(STDIN_FILENO, F_SETFL, fcntl(0, F_GETFL) | O_NONBLOCK);
@@ -0,0 +1,100 @@
+#include "orbit.hpp"
+#include <cmath>
+#include <algorithm>
+
+namespace orbit {
+
+double
+eccentricAnomaly(double M, double e)
+{
+    double E = M;
+    for(int its = 0; its < 512; its++) {
+        double dE = (E - e * std::sin(E) - M) / (1 - e * std::cos(E));
+        E -= dE;
+        if(std::abs(dE) < 1e-6) break;
+    }
+    return E;
+}
+
+double
+trueAnomaly(double e, double E)
+{
+    double x = std::cos(E) - e;
+    double y = std::sin(E) * std::sqrt(1 - e * e);
+    return std::atan2(y, x);
+}
+
+vex::vec2<long>
+position(const ecs::OrbitalComponent &oc, double E)
+{
+    double x = std::cos(E) - oc.e;
+    double y = std::sin(E) * std::sqrt(1 - oc.e * oc.e);
+
+    double v = std::atan2(y, x) + oc.w;
+    double r = std::sqrt(x*x + y*y) * (double)oc.a;
+
+    vex::vec2<double> polar(r, v);
+    return vex::cartesian<long>(polar);
+}
+
+namespace {
+
+struct PathBuilder {
+    const ecs::OrbitalComponent &oc;
+    double cosw, sinw, b;
+    double tolerance;
+    Path &points;
+
+    vex::vec2<double> at(double E) const {
+        double x = (double)oc.a * (std::cos(E) - oc.e);
+        double y = b * std::sin(E);
+        return vex::vec2<double>(x * cosw - y * sinw, x * sinw + y * cosw);
+    }
+
+    /*Emits the points after p0 up to and including p1*/
+    void subdivide(double E0, const vex::vec2<double> &p0, double E1, const vex::vec2<double> &p1, unsigned depth) {
+        double Em = (E0 + E1) / 2.0;
+        vex::vec2<double> pm = at(Em);
+        vex::vec2<double> chord = p1 - p0;
+        vex::vec2<double> offset = pm - p0;
+        double length = chord.magnitude();
+        double deviation = length > 0.0 ?
+            std::abs(chord[0] * offset[1] - chord[1] * offset[0]) / length :
+            offset.magnitude();
+
+        if(deviation > tolerance && depth < 14) {
+            subdivide(E0, p0, Em, pm, depth + 1);
+            subdivide(Em, pm, E1, p1, depth + 1);
+            return;
+        }
+        points.push_back(vex::vec2<long>((long)p1[0], (long)p1[1]));
+    }
+};
+
+}
+
+Path
+path(const ecs::OrbitalComponent &oc, long tolerance)
+{
+    Path points;
+    PathBuilder builder{oc, std::cos(oc.w), std::sin(oc.w),
+        (double)oc.a * std::sqrt(1 - oc.e * oc.e), (double)std::max<long>(1, tolerance), points};
+
+    //Quarter turns are the coarsest the deviation test can still refine reliably
+    constexpr unsigned quarters = 4;
+    const vex::vec2<double> first = builder.at(0.0);
+    vex::vec2<double> prev = first;
+    points.push_back(vex::vec2<long>((long)first[0], (long)first[1]));
+    for(unsigned i = 1; i <= quarters; i++) {
+        double E0 = tau * (i - 1) / quarters;
+        double E1 = tau * i / quarters;
+        vex::vec2<double> next = i == quarters ? first : builder.at(E1);
+        builder.subdivide(E0, prev, E1, next, 0);
+        prev = next;
+    }
+    //The last point closes the loop back onto the first
+    points.pop_back();
+    return points;
+}
+
+}
@@ -0,0 +1,137 @@
+#include "spatial.hpp"
+
+namespace spatial {
+
+QuadTree::QuadTree(long halfsize) :
+    m_size(0)
+{
+    m_nodes.push_back({vex::vec2<long>(0, 0), halfsize, 0, -1, -1, 0, {}});
+}
+
+bool
+QuadTree::looseContains(const Node &node, const vex::vec2<long> &position) const
+{
+    long reach = node.half * 2;
+    return position[0] >= node.center[0] - reach && position[0] < node.center[0] + reach &&
+           position[1] >= node.center[1] - reach && position[1] < node.center[1] + reach;
+}
+
+bool
+QuadTree::looseIntersects(const Node &node, const shapes::rectangle<long> &rect) const
+{
+    //The root keeps anything that falls outside of the tree entirely
+    if(node.depth == 0) return true;
+    long reach = node.half * 2;
+    return rect.position[0] < node.center[0] + reach && rect.position[0] + rect.bounds[0] > node.center[0] - reach &&
+           rect.position[1] < node.center[1] + reach && rect.position[1] + rect.bounds[1] > node.center[1] - reach;
+}
+
+unsigned
+QuadTree::quadrant(const Node &node, const vex::vec2<long> &position) const
+{
+    return (position[0] >= node.center[0] ? 1 : 0) | (position[1] >= node.center[1] ? 2 : 0);
+}
+
+/*Files an entry already counted at nodeIndex somewhere in its subtree*/
+void
+QuadTree::place(int nodeIndex, unsigned id)
+{
+    Entry &entry = m_entries[id];
+    //Descend while the tight quadrant below can take the entry
+    while(m_nodes[nodeIndex].children >= 0) {
+        const Node &node = m_nodes[nodeIndex];
+        int child = node.children + (int)quadrant(node, entry.position);
+        if(!looseContains(m_nodes[child], entry.position)) break;
+        nodeIndex = child;
+        m_nodes[nodeIndex].count++;
+    }
+    Node &node = m_nodes[nodeIndex];
+    entry.node = nodeIndex;
+    entry.slot = (unsigned)node.entries.size();
+    node.entries.push_back(id);
+
+    //A split node keeps what its children cannot take, so it never splits again
+    if(node.children < 0 && node.entries.size() > NODE_CAPACITY && node.depth < MAX_DEPTH && node.half > 1) split(nodeIndex);
+}
+
+void
+QuadTree::split(int nodeIndex)
+{
+    int first = (int)m_nodes.size();
+    long half = m_nodes[nodeIndex].half / 2;
+    vex::vec2<long> center = m_nodes[nodeIndex].center;
+    unsigned depth = m_nodes[nodeIndex].depth + 1;
+    for(unsigned q = 0; q < 4; q++) {
+        vex::vec2<long> offset((q & 1) ? half : -half, (q & 2) ? half : -half);
+        m_nodes.push_back({center + offset, half, depth, -1, nodeIndex, 0, {}});
+    }
+    m_nodes[nodeIndex].children = first;
+
+    std::vector<unsigned> entries;
+    entries.swap(m_nodes[nodeIndex].entries);
+    for(unsigned id : entries) place(nodeIndex, id);
+}
+
+void
+QuadTree::detach(unsigned id)
+{
+    Entry &entry = m_entries[id];
+    std::vector<unsigned> &entries = m_nodes[entry.node].entries;
+    unsigned moved = entries.back();
+    entries[entry.slot] = moved;
+    m_entries[moved].slot = entry.slot;
+    entries.pop_back();
+    for(int node = entry.node; node >= 0; node = m_nodes[node].parent) m_nodes[node].count--;
+    entry.node = -1;
+}
+
+/*Any entry at or below a node that holds at least one*/
+unsigned
+QuadTree::firstEntry(int nodeIndex) const
+{
+    for(;;) {
+        const Node &node = m_nodes[nodeIndex];
+        if(!node.entries.empty() || node.children < 0) return node.entries.front();
+        for(int i = 0; i < 4; i++) {
+            if(m_nodes[node.children + i].count > 0) {
+                nodeIndex = node.children + i;
+                break;
+            }
+        }
+    }
+}
+
+void
+QuadTree::insert(unsigned id, const vex::vec2<long> &position)
+{
+    if(id >= m_entries.size()) m_entries.resize(id + 1);
+    if(contains(id)) {
+        update(id, position);
+        return;
+    }
+    m_entries[id].position = position;
+    m_nodes[0].count++;
+    place(0, id);
+    m_size++;
+}
+
+void
+QuadTree::update(unsigned id, const vex::vec2<long> &position)
+{
+    Entry &entry = m_entries[id];
+    entry.position = position;
+    if(entry.node == 0 || looseContains(m_nodes[entry.node], position)) return;
+    detach(id);
+    m_nodes[0].count++;
+    place(0, id);
+}
+
+void
+QuadTree::remove(unsigned id)
+{
+    if(!contains(id)) return;
+    detach(id);
+    m_size--;
+}
+
+}
@@ -4,9 +4,13 @@
 #include "vex.hpp"
 #include "units.hpp"
 #include "csv.hpp"
+#include "orbit.hpp"
 #include "keybind.hpp"
 #include "game.hpp"
+#include "workers.hpp"
 #include <numbers>
+#include <cmath>
+#include <bit>
 #include <string>
 
 static double G = 6.6743 * std::pow(10, -11);
@@ -30,15 +34,32 @@ System::addOrbital(const std::string &name,
         .addComponent(ecs::MassComponent{m})
         .addComponent(ecs::RenderCircleComponent{r})
         .addComponent(ecs::NameComponent{name});
+    if(m_treeNodes.size() <= newOrbital.id) m_treeNodes.resize(newOrbital.id + 1, nullptr);
     if(treeNode != nullptr) {
         newOrbital.addComponent(ecs::OrbitalComponent{.origin = (unsigned)treeNode->entityId, .a = (long)a, .e = e, .w = w, .M = M, .T = 0, .v = 0});
-        treeNode->children.push_back({(int)newOrbital.id, {}});
+        treeNode->children.push_back({(int)newOrbital.id, {}, treeNode});
+        m_treeNodes[newOrbital.id] = &treeNode->children.back();
     }else{
         m_systemTree.entityId = newOrbital.id;
+        m_treeNodes[newOrbital.id] = &m_systemTree;
     }
+    m_maxRadius = std::max(m_maxRadius, r);
 }
 
-System::System(const std::string &name)
+long
+System::computeBounds(SystemTreeNode &node)
+{
+    node.bound = m_entityMan[node.entityId].get<ecs::RenderCircleComponent>().radius;
+    for(SystemTreeNode &child : node.children) {
+        auto &oc = m_entityMan[child.entityId].get<ecs::OrbitalComponent>();
+        long apoapsis = (long)((double)oc.a * (1.0 + oc.e));
+        node.bound = std::max(node.bound, apoapsis + computeBounds(child));
+    }
+    return node.bound;
+}
+
+System::System(const std::string &name) :
+    m_index(1L << 42), m_maxRadius(0), m_lastTick(std::numeric_limits<long>::min())
 {
     m_systemTree.entityId = -1;
     csv::CSVFile<',', std::string, std::string, double, double, double, double, double, double, std::string> bodyData(name);
@@ -55,59 +76,138 @@ System::System(const std::string &name)
         if(name == "Missing") name = std::get<8>(body);
         addOrbital(name, orbiting, sma, e, m, r, M, w);
     }
+    if(m_systemTree.entityId != -1) computeBounds(m_systemTree);
+
+    for(unsigned id = 0; id < m_entityMan.size(); id++) m_bySize.push_back(id);
+    std::stable_sort(m_bySize.begin(), m_bySize.end(), [this](unsigned a, unsigned b) {
+        return m_entityMan[a].get<ecs::RenderCircleComponent>().radius > m_entityMan[b].get<ecs::RenderCircleComponent>().radius;
+    });
 }
 
-constexpr static double tau = std::numbers::pi * 2;
+using orbit::tau;
+
+//Most orbit segments batched in one frame, and the smallest orbit worth drawing
+constexpr static std::size_t ORBIT_SEGMENT_BUDGET = 4096;
+constexpr static double ORBIT_MIN_CELLS = 4.0;
+//Camera layers, each drawn over the ones before it
+constexpr static int LAYER_ORBITS = 0;
+constexpr static int LAYER_FOCUS_ORBIT = 1;
+constexpr static int LAYER_BODIES = 2;
+constexpr static int LAYER_LARGE_BODIES = 3;
+//Insets open this many times closer in than the main view
+constexpr static long INSET_ZOOM = 16;
+//Cached orbit paths left unused for this many batched frames are dropped
+constexpr static unsigned ORBIT_PATH_FRAMES = 64;
 
 void
-System::tickOrbitals(unit::Time time)
+System::tickOrbital(ecs::Entity &e, unit::Time time)
 {
-    for(ecs::Entity &e : m_entityMan.getWith<ecs::OrbitalComponent>()) {
-        auto &oc = e.get<ecs::OrbitalComponent>();
-        auto &pc = e.get<ecs::PositionComponent>();
-        auto &mc = e.get<ecs::MassComponent>();
-
-        ecs::Entity &o = m_entityMan[oc.origin];
-        auto &opc = o.get<ecs::PositionComponent>();
-        auto &om = o.get<ecs::MassComponent>();
-
-        double e2 = oc.e * oc.e;
-        double td = (double)time();
-        if(oc.T == 0) {
-            double u = G * (om.mass() + mc.mass());
-            double am = (double)oc.a * 1000.0;
-            oc.T = tau * std::sqrt((am * am * am) / u);
-        }
-        double n = tau / oc.T;
-        double M = oc.M + (n * td);
-        double E = M;
-
-        int its = 0;
-        while(true) {
-            double dE = (E - oc.e * std::sin(E) - M) / (1 - oc.e * std::cos(E));
-            E -= dE;
-            its++;
-            if(std::abs(dE) < 1e-6) break;
-        }
+    if(!e.contains<ecs::OrbitalComponent>()) return;
+    auto &oc = e.get<ecs::OrbitalComponent>();
+    auto &pc = e.get<ecs::PositionComponent>();
+    auto &mc = e.get<ecs::MassComponent>();
+
+    ecs::Entity &o = m_entityMan[oc.origin];
+    auto &opc = o.get<ecs::PositionComponent>();
+    auto &om = o.get<ecs::MassComponent>();
+
+    double td = (double)time();
+    if(oc.T == 0) {
+        double u = G * (om.mass() + mc.mass());
+        double am = (double)oc.a * 1000.0;
+        oc.T = tau * std::sqrt((am * am * am) / u);
+    }
+    double n = tau / oc.T;
+    double E = orbit::eccentricAnomaly(oc.M + (n * td), oc.e);
 
-        double x = std::cos(E) - oc.e;
-        double y = std::sin(E) * std::sqrt(1 - e2);
+    oc.v = orbit::trueAnomaly(oc.e, E) + oc.w;
+    pc.position = orbit::position(oc, E) + opc.position;
+}
 
-        double v = std::atan2(y, x) + oc.w;
-        oc.v = v;
+void
+System::evaluate(SystemTreeNode &node, unit::Time time)
+{
+    if(node.epoch == time()) return;
+    if(node.parent != nullptr) evaluate(*node.parent, time);
+    tickOrbital(m_entityMan[node.entityId], time);
+    node.epoch = time();
+}
 
-        double r = std::sqrt(x*x + y*y) * (double)oc.a;
+/*Tests the annulus a body's subtree sweeps around its parent against every view*/
+bool
+System::sweepVisible(const vex::vec2<long> &origin, const SystemTreeNode &node)
+{
+    auto &oc = m_entityMan[node.entityId].get<ecs::OrbitalComponent>();
+    double outer = (double)oc.a * (1.0 + oc.e) + (double)node.bound;
+    double inner = std::max(0.0, (double)oc.a * (1.0 - oc.e) - (double)node.bound);
+    double cx = (double)origin[0], cy = (double)origin[1];
+
+    for(auto &frustum : m_frusta) {
+        double x0 = (double)frustum.position[0], x1 = x0 + (double)frustum.bounds[0];
+        double y0 = (double)frustum.position[1], y1 = y0 + (double)frustum.bounds[1];
+
+        double nx = std::max({x0 - cx, 0.0, cx - x1});
+        double ny = std::max({y0 - cy, 0.0, cy - y1});
+        if((nx * nx) + (ny * ny) > outer * outer) continue;
+
+        double fx = std::max(std::abs(cx - x0), std::abs(cx - x1));
+        double fy = std::max(std::abs(cy - y0), std::abs(cy - y1));
+        if((fx * fx) + (fy * fy) < inner * inner) continue;
+        return true;
+    }
+    return false;
+}
 
-        vex::vec2<double> polar(r, v);
-        pc.position = vex::cartesian<long>(polar) + opc.position; 
+void
+System::cullSubtree(SystemTreeNode &node, unit::Time time)
+{
+    evaluate(node, time);
+    auto &pc = m_entityMan[node.entityId].get<ecs::PositionComponent>();
+    if(node.active) {
+        m_index.update(node.entityId, pc.position);
+    }else{
+        m_index.insert(node.entityId, pc.position);
+        node.active = true;
+    }
+
+    for(SystemTreeNode &child : node.children) {
+        if(sweepVisible(pc.position, child)) cullSubtree(child, time);
+        else deactivate(child);
     }
+}
 
+void
+System::deactivate(SystemTreeNode &node)
+{
+    //An inactive node's whole subtree is already out of the index
+    if(!node.active) return;
+    node.active = false;
+    m_index.remove(node.entityId);
+    for(SystemTreeNode &child : node.children) deactivate(child);
 }
 
 void
-System::update() 
+System::update(std::span<const View> views)
 {
-    tickOrbitals(TimeMan::time());
+    if(m_systemTree.entityId == -1) return;
+    unit::Time time = TimeMan::time();
+
+    std::size_t frustumCount = m_frusta.size();
+    bool moved = frustumCount != views.size();
+    m_frusta.resize(views.size(), shapes::rectangle<long>(0, 0, 0, 0));
+    for(std::size_t i = 0; i < views.size(); i++) {
+        SystemTreeNode *focus = m_treeNodes[views[i].focus];
+        evaluate(*focus, time);
+
+        shapes::rectangle<long> frustum = views[i].frustum;
+        frustum.position += m_entityMan[focus->entityId].get<ecs::PositionComponent>().position;
+        moved |= frustum.position != m_frusta[i].position || frustum.bounds != m_frusta[i].bounds;
+        m_frusta[i] = frustum;
+    }
+    if(!moved && time() == m_lastTick) return;
+    m_lastTick = time();
+
+    cullSubtree(m_systemTree, time);
 }
 
 ecs::Entity &
@@ -144,13 +244,31 @@ void
 SystemView::view(System *system) 
 { 
     m_system = system;
-    m_focus = &system->m_systemTree;
+    for(Viewport &viewport : m_viewports) viewport.focus = nullptr;
+    if(!m_viewports.empty()) focus() = &system->m_systemTree;
+}
+
+void
+SystemView::addViewport(Camera *camera, const std::string &window)
+{
+    System::SystemTreeNode *follow = m_viewports.empty() && m_system != nullptr ? &m_system->m_systemTree : nullptr;
+    m_viewports.push_back(Viewport{camera, window, follow});
 }
 
+/*Points the viewport at node and centres its camera there straight away,
+ * since update leaves the origins alone while paused*/
 void
-SystemView::keypress(Camera *camera, int key)
+SystemView::follow(Viewport &viewport, System::SystemTreeNode *node)
+{
+    viewport.focus = node;
+    viewport.camera->setorigin(m_system->m_entityMan[node->entityId].get<ecs::PositionComponent>().position);
+}
+
+void
+SystemView::keypress(int key)
 {
     WindowContext &context = Game::contexts();
+    Camera *camera = m_viewports.front().camera;
     if(context.getFocusedString() == WINDOW_SYSTEMVIEW_SEARCH_ID) {
         m_focusSearch->keypress(key);
         if(!Game::paused()) {
@@ -165,6 +283,38 @@ SystemView::keypress(Camera *camera, int key)
     if(key == KeyMan::binds[BIND_SYSTEMVIEW_PANLEFT].code) camera->move(-(long)camera->getscale(), 0);
     if(key == KeyMan::binds[BIND_SYSTEMVIEW_INCSCALE].code) camera->setscale(camera->getscale() * 2);
     if(key == KeyMan::binds[BIND_SYSTEMVIEW_DECSCALE].code) camera->setscale(camera->getscale() / 2);
+    if(key == KeyMan::binds[BIND_SYSTEMVIEW_ORBITS].code) {
+        m_showOrbits = !m_showOrbits;
+        camera->markDirty();
+    }
+    if(key == input::CTRL_KEY_MOUSE && input::getmouse().leftclick()) {
+        //Each camera kept what it drew in each cell, so a click is one lookup
+        const input::MouseEvent &mouse = input::getmouse();
+        std::string window = context.windowAt(mouse.x, mouse.y);
+        //A click retargets the viewport it lands in, so one in an inset moves only that inset
+        for(Viewport &viewport : m_viewports) {
+            if(viewport.focus == nullptr || viewport.window != window) continue;
+            auto *screen = context[viewport.window].screen();
+            std::uint32_t id = viewport.camera->pick(mouse.x - screen->getx(), mouse.y - screen->gety());
+            if(id != Camera::NO_PICK && m_system->m_treeNodes[id] != nullptr) follow(viewport, m_system->m_treeNodes[id]);
+        }
+    }
+    if(key == KeyMan::binds[BIND_SYSTEMVIEW_FOLLOW].code) {
+        //The inset already following the focus closes, otherwise a free one,
+        //or the first when all are taken, switches to it
+        auto insets = std::span<Viewport>(m_viewports).subspan(1);
+        auto inset = std::find_if(insets.begin(), insets.end(), [this](const Viewport &v) { return v.focus == focus(); });
+        if(inset != insets.end()) {
+            inset->focus = nullptr;
+            context.setWindowHidden(inset->window, true);
+        }else if(!insets.empty()) {
+            inset = std::find_if(insets.begin(), insets.end(), [](const Viewport &v) { return v.focus == nullptr; });
+            if(inset == insets.end()) inset = insets.begin();
+            follow(*inset, focus());
+            inset->camera->setscale(camera->getscale() / INSET_ZOOM);
+            context.setWindowHidden(inset->window, false);
+        }
+    }
     if(key == KeyMan::binds[BIND_SYSTEMVIEW_SEARCH].code) {
         Game::setState(Game::State::PAUSED_INPUT);
         context.focus(WINDOW_SYSTEMVIEW_SEARCH_ID);
@@ -174,25 +324,41 @@ SystemView::keypress(Camera *camera, int key)
 }
 
 void 
-SystemView::update(Camera *camera)
+SystemView::update()
 {
+    //Every viewport asks only for the bodies its camera can see, widened by
+    //the smallest drawn radius, and the system walks its tree once for all
+    m_views.clear();
+    for(const Viewport &viewport : m_viewports) {
+        if(viewport.focus == nullptr) continue;
+        Camera *camera = viewport.camera;
+        shapes::rectangle<long> frustum = camera->getview();
+        frustum.position -= camera->getorigin() + vex::vec2<long>(camera->getscale(), camera->getscale());
+        frustum.bounds += vex::vec2<long>(camera->getscale() * 2, camera->getscale() * 2);
+        m_views.push_back(System::View{viewport.focus->entityId, frustum});
+    }
+    m_system->update(m_views);
+
     if(Game::paused()) return;
-    auto &efoc = m_system->m_entityMan[m_focus->entityId];
-    auto &efocp = efoc.get<ecs::PositionComponent>();
-    if(efocp.position != camera->getorigin()) {
-        camera->setorigin(efocp.position);
+    for(const Viewport &viewport : m_viewports) {
+        if(viewport.focus == nullptr) continue;
+        auto &efocp = m_system->m_entityMan[viewport.focus->entityId].get<ecs::PositionComponent>();
+        if(efocp.position != viewport.camera->getorigin()) {
+            viewport.camera->setorigin(efocp.position);
+        }
     }
 }
 
 void
-SystemView::drawOver(Camera *camera) {
-    auto &efoc = m_system->m_entityMan[m_focus->entityId];
+SystemView::drawOver() {
+    Camera *camera = m_viewports.front().camera;
+    auto &efoc = m_system->m_entityMan[focus()->entityId];
     auto &efocp = efoc.get<ecs::PositionComponent>();
     auto &efocm = efoc.get<ecs::MassComponent>();
 
     WindowContext &context = Game::contexts();
     Window &infoWindow = context[WINDOW_BODYINFO_ID];
-    Window &viewWindow = context[WINDOW_SYSTEMVIEW_ID];
+    Window &viewWindow = context[m_viewports.front().window];
 
     infoWindow << straw::clear(' ');
     infoWindow << straw::move(0, 0) << "Focus: " << efoc.get<ecs::NameComponent>().name << '\n';
@@ -201,7 +367,9 @@ SystemView::drawOver(Camera *camera) {
         ecs::Entity &efoc_origin = m_system->m_entityMan[efoco.origin];
 
         infoWindow << "Orbiting: " << efoc_origin.get<ecs::NameComponent>().name << '\n';
-        infoWindow << "Distance: " << std::abs((double)(efocp.position - efoc_origin.get<ecs::PositionComponent>().position).magnitude()) << "km\n";
+        //Squared in long this overflows past about 14 AU
+        vex::vec2<long> offset = efocp.position - efoc_origin.get<ecs::PositionComponent>().position;
+        infoWindow << "Distance: " << std::hypot((double)offset[0], (double)offset[1]) << "km\n";
         infoWindow << "Period: " << efoco.T / unit::DAY_SECONDS << " days\n";
         infoWindow << "Angle: " << efoco.v * (180.0 / std::numbers::pi) << '\n';
         infoWindow << "Eccentricity: " << efoco.e << '\n';
@@ -210,12 +378,14 @@ SystemView::drawOver(Camera *camera) {
     vex::vec2<unsigned> viewdims(
                 viewWindow.screen()->getwidth(),
                 viewWindow.screen()->getheight());
+    //The focus body sits at the centre of the view, keep those rows current first
+    viewWindow.setHotspot(viewdims[1] / 3, viewdims[1] - (viewdims[1] / 3));
 
     viewWindow << straw::move(0, 0) << 
                   straw::setcolor(straw::WHITE, straw::BLACK) << 
                   "Press '" << 
                   KeyMan::translateCode(KeyMan::binds[BIND_SYSTEMVIEW_SEARCH].code) << 
-                  "' to change focus";
+                  "' or click a body to change focus";
 
     double scale = camera->getscale() * (viewdims[0] / 2.0);
     if(scale > 1e7) {
@@ -224,78 +394,217 @@ SystemView::drawOver(Camera *camera) {
         viewWindow << straw::move(0, viewdims[1] - 1) << scale << " km";
     }
 
+    for(const Viewport &inset : std::span<const Viewport>(m_viewports).subspan(1)) {
+        if(inset.focus == nullptr) continue;
+        context[inset.window] << straw::move(0, 0) << straw::setcolor(straw::WHITE, straw::BLACK) <<
+                                 m_system->m_entityMan[inset.focus->entityId].get<ecs::NameComponent>().name;
+    }
 }
 
 void
-SystemView::draw(Camera *camera)
+SystemView::draw()
 {
     if(m_focusSearch != nullptr) m_focusSearch->draw();
-    if(!camera->dirty()) return;
-    auto &efoc = m_system->m_entityMan[m_focus->entityId];
+    bool batched = false;
+    for(const Viewport &viewport : m_viewports) {
+        if(viewport.focus == nullptr || !viewport.camera->dirty()) continue;
+        batchView(viewport);
+        batched = true;
+    }
+    //Every zoom level leaves its own paths behind, keep the ones still drawn
+    if(batched) {
+        m_orbitFrame++;
+        std::erase_if(m_orbitPaths, [this](const auto &entry) { return m_orbitFrame - entry.second.used > ORBIT_PATH_FRAMES; });
+    }
+}
+
+/*Cameras draw one after another, each splitting its own rows across the
+ * whole pool. Running them on the pool too would leave their tiles serial*/
+void
+SystemView::render()
+{
+    for(const Viewport &viewport : m_viewports) {
+        if(viewport.focus != nullptr) viewport.camera->draw();
+    }
+}
+
+void
+SystemView::batchView(const Viewport &viewport)
+{
+    Camera *camera = viewport.camera;
+    auto &efoc = m_system->m_entityMan[viewport.focus->entityId];
     auto &efocp = efoc.get<ecs::PositionComponent>();
     auto &efocm = efoc.get<ecs::MassComponent>();
 
-    if(efoc.contains<ecs::OrbitalComponent>()) {
-        auto &oc = efoc.get<ecs::OrbitalComponent>();
-        auto &om = efoc.get<ecs::MassComponent>();
-        ecs::Entity &origin = m_system->m_entityMan[oc.origin];
-        auto pc = origin.get<ecs::PositionComponent>();
-    
-        std::vector<vex::vec2<long>> points;
-        float i = 0.0;
-        while(i < tau){
-            double e2 = oc.e * oc.e;
-            double M = oc.M + i;
-            double E = M;
-            
-            int its = 0;
-            while(its < 512) {
-                double dE = (E - oc.e * std::sin(E) - M) / (1 - oc.e * std::cos(E));
-                E -= dE;
-                its++;
-                if(std::abs(dE) < 1e-6) break;
-            }
-            
-            double x = (std::cos(E) - oc.e);
-            double y = (std::sin(E) * std::sqrt(1 - e2));
-
-            double v = std::atan2(y, x) + oc.w;
-            double r = std::sqrt(x*x + y*y) * (double)oc.a;
-            
-
-            vex::vec2<double> polar{r, v};
-            vex::vec2<long> cart = vex::cartesian<long>(polar) + pc.position;
-
-            points.push_back(cart);
-            i += 0.01;
-        }
-        for(unsigned i = 0; i < points.size(); i++) {
-            if(i == 0) {
-                camera->batchShape(shapes::line<long>(points[points.size() - 1], points[i]), straw::color(0, 0, 255), '#');
-            }else{
-                camera->batchShape(shapes::line<long>(points[i-1], points[i]), straw::color(0, 0, 255), '#');
-            }
+    //After a pan only the uncovered strips are drawn, so only what touches them is submitted
+    std::span<const shapes::rectangle<long>> views = camera->getdrawviews();
+    if(m_showOrbits) {
+        //Larger and nearer orbits get their share of the budget first
+        std::size_t budget = ORBIT_SEGMENT_BUDGET;
+        m_orbitQueue.clear();
+        queueOrbits(camera, m_system->m_systemTree);
+        std::sort(m_orbitQueue.begin(), m_orbitQueue.end(), std::greater<>());
+        for(auto &[priority, id] : m_orbitQueue) {
+            if(budget == 0) break;
+            if(id == efoc.id) continue;
+            budget -= batchOrbit(camera, views, id, camera->getscale(), straw::color(96, 96, 160), '.', LAYER_ORBITS, budget);
         }
     }
-    
-    for(ecs::Entity &e : m_system->m_entityMan.getWith<ecs::RenderCircleComponent>()) {
+    //The focus orbit is always drawn in full, and on top
+    if(efoc.contains<ecs::OrbitalComponent>()) {
+        batchOrbit(camera, views, efoc.id, camera->getscale(), straw::color(0, 0, 255), '#', LAYER_FOCUS_ORBIT, std::numeric_limits<std::size_t>::max());
+    }
+
+    for(const shapes::rectangle<long> &view : views) {
+        batchDensity(camera, view);
+        batchBodies(camera, view, (unsigned)efoc.id);
+    }
+}
+
+/*Bodies at least a cell across, and the focus, drawn one by one over the density map*/
+void
+SystemView::batchBodies(Camera *camera, const shapes::rectangle<long> &view, unsigned focus)
+{
+    long scale = camera->getscale();
+    auto batch = [this, camera, &view, scale, focus](unsigned id) {
+        if(!m_system->m_index.contains(id)) return;
+        ecs::Entity &e = m_system->m_entityMan[id];
         auto &pc = e.get<ecs::PositionComponent>();
         auto &cc = e.get<ecs::RenderCircleComponent>();
-        unsigned id = e.id;
-        
-        long cr = cc.radius;
-        if(cr < camera->getscale()) cr = camera->getscale();
-        shapes::ellipse<long> circle(pc.position, cr, cr); 
-        
-        straw::color color = id == m_focus->entityId ? straw::color{255, 255, 0} : straw::WHITE;
-        if(cc.radius < cr) {
-            camera->batchShape(circle, color, '*');
-        }else{
-            camera->batchShape(circle, color, '#');
+
+        long cr = std::max<long>(cc.radius, scale);
+        if(pc.position[0] + cr < view.position[0] || pc.position[0] - cr > view.position[0] + view.bounds[0] ||
+           pc.position[1] + cr < view.position[1] || pc.position[1] - cr > view.position[1] + view.bounds[1]) return;
+        shapes::ellipse<long> circle(pc.position, cr, cr);
+
+        straw::color color = id == focus ? straw::color{255, 255, 0} : straw::WHITE;
+        camera->batchShape(circle, color, cc.radius < cr ? '*' : '#', LAYER_LARGE_BODIES, id);
+    };
+    for(unsigned id : m_system->m_bySize) {
+        if(m_system->m_entityMan[id].get<ecs::RenderCircleComponent>().radius < scale) break;
+        if(id != focus) batch(id);
+    }
+    batch(focus);
+}
+
+/*Bodies smaller than a cell all look the same, so they are binned per cell
+ * and each occupied cell drawn once, with a glyph for how crowded it is.
+ * Bands of rows are counted in parallel, each into its own part of the grid*/
+void
+SystemView::batchDensity(Camera *camera, const shapes::rectangle<long> &view)
+{
+    long scale = camera->getscale();
+    long width = view.bounds[0] / scale, height = view.bounds[1] / scale;
+    if(width <= 0 || height <= 0) return;
+    m_density.assign((std::size_t)(width * height), 0);
+    m_densityPick.resize(m_density.size());
+
+    long bands = std::min<long>(height, workers::pool.size());
+    workers::pool.run((std::size_t)bands, [&](std::size_t band) {
+        long y0 = (height * (long)band) / bands, y1 = (height * ((long)band + 1)) / bands;
+        shapes::rectangle<long> rows(view.position[0], view.position[1] + (y0 * scale), view.bounds[0], (y1 - y0) * scale);
+        std::uint32_t *counts = m_density.data() + (y0 * width);
+        std::uint32_t *picks = m_densityPick.data() + (y0 * width);
+        m_system->m_index.density(rows, scale, [counts, picks, width](long i, long j, std::size_t n, unsigned id) {
+            counts[(j * width) + i] += (std::uint32_t)n;
+            picks[(j * width) + i] = id;
+        });
+    });
+
+    struct Level { std::uint32_t count; straw::color color; char c; };
+    static constexpr Level levels[] = {
+        {64, straw::color{255, 110, 40}, '@'},
+        {8, straw::color{255, 170, 80}, '@'},
+        {2, straw::color{255, 220, 140}, '%'},
+        {1, straw::WHITE, '*'},
+    };
+    for(long j = 0; j < height; j++) {
+        for(long i = 0; i < width; i++) {
+            std::uint32_t n = m_density[(j * width) + i];
+            if(n == 0) continue;
+            const Level &level = *std::find_if(std::begin(levels), std::end(levels), [n](const Level &l) { return n >= l.count; });
+            vex::vec2<long> cell = view.position + vex::vec2<long>(i * scale, j * scale);
+            camera->batchShape(shapes::ellipse<long>(cell, scale, scale), level.color, level.c, LAYER_BODIES,
+                               m_densityPick[(j * width) + i]);
+        }
+    }
+}
+
+/*Segments count against the budget wherever they fall in the view, so an orbit
+ * is sampled the same whether the frame is drawn whole or a strip at a time*/
+std::size_t
+SystemView::batchOrbit(Camera *camera, std::span<const shapes::rectangle<long>> views, unsigned id, long scale,
+                       straw::color color, char c, int layer, std::size_t budget)
+{
+    auto &oc = m_system->m_entityMan[id].get<ecs::OrbitalComponent>();
+    vex::vec2<long> origin = m_system->m_entityMan[oc.origin].get<ecs::PositionComponent>().position;
+
+    //Fall back to coarser sampling for orbits that would overrun the budget
+    const orbit::Path *path = &orbitPath(id, scale);
+    while(path->size() > budget && path->size() > 4) {
+        scale *= 2;
+        path = &orbitPath(id, scale);
+    }
+    if(path->size() > budget) return 0;
+
+    //Paths are cached around the orbited body, only its position changes
+    const orbit::Path &points = *path;
+    auto outside = [](const shapes::rectangle<long> &view, const vex::vec2<long> &a, const vex::vec2<long> &b) {
+        vex::vec2<long> vmin = view.position, vmax = view.position + view.bounds;
+        return std::max(a[0], b[0]) < vmin[0] || std::min(a[0], b[0]) > vmax[0] ||
+               std::max(a[1], b[1]) < vmin[1] || std::min(a[1], b[1]) > vmax[1];
+    };
+    shapes::rectangle<long> view = camera->getview();
+    std::size_t batched = 0;
+    for(unsigned i = 0; i < points.size(); i++) {
+        vex::vec2<long> a = points[i == 0 ? points.size() - 1 : i - 1] + origin;
+        vex::vec2<long> b = points[i] + origin;
+        if(outside(view, a, b)) continue;
+        batched++;
+        if(std::all_of(views.begin(), views.end(), [&](const shapes::rectangle<long> &v) { return outside(v, a, b); })) continue;
+        camera->batchShape(shapes::line<long>(a, b), color, c, layer, id);
+    }
+    return batched;
+}
+
+void
+SystemView::queueOrbits(Camera *camera, System::SystemTreeNode &node)
+{
+    //Only evaluated subtrees can have an orbit crossing the view
+    shapes::rectangle<long> view = camera->getview();
+    vex::vec2<long> center = view.position + (view.bounds / 2L);
+    double extent = (double)std::max(view.bounds[0], view.bounds[1]);
+    double scale = (double)camera->getscale();
+    vex::vec2<long> origin = m_system->m_entityMan[node.entityId].get<ecs::PositionComponent>().position;
+    double distance = std::hypot((double)(center[0] - origin[0]), (double)(center[1] - origin[1]));
+
+    for(System::SystemTreeNode &child : node.children) {
+        if(!child.active) continue;
+        auto &oc = m_system->m_entityMan[child.entityId].get<ecs::OrbitalComponent>();
+        double radius = (double)oc.a;
+        if((radius * 2.0) / scale >= ORBIT_MIN_CELLS) {
+            double gap = std::abs(distance - radius);
+            m_orbitQueue.emplace_back((radius / scale) / (1.0 + gap / extent), child.entityId);
         }
+        queueOrbits(camera, child);
     }
 }
 
+const orbit::Path &
+SystemView::orbitPath(unsigned id, long scale)
+{
+    //Sampling to the largest power of two under scale keeps error below a cell
+    unsigned level = std::bit_width((unsigned long)std::max<long>(1, scale)) - 1;
+    std::uint64_t key = ((std::uint64_t)id << 6) | level;
+    auto path = m_orbitPaths.find(key);
+    if(path == m_orbitPaths.end()) {
+        auto &oc = m_system->m_entityMan[id].get<ecs::OrbitalComponent>();
+        path = m_orbitPaths.emplace(key, CachedPath{orbit::path(oc, 1L << level), 0}).first;
+    }
+    path->second.used = m_orbitFrame;
+    return path->second.path;
+}
+
 ecs::Entity &
 SystemView::getBody(int id) const
 {
@@ -343,7 +652,7 @@ SystemView::Search::rebuild()
 
     addNodeToTree(m_displayTree, systemRoot);
     for(unsigned i = 0; auto *node : m_displayTreeFlat) {
-        if(m_systemView->m_focus == node->node) {
+        if(m_systemView->focus() == node->node) {
             m_selectionIndex = i;
             break;
         }
@@ -455,11 +764,12 @@ SystemView::Search::keypress(int key)
         m_dirty = true;
     }else
     if(key == KeyMan::binds[BIND_G_SELECT].code) {
-        m_systemView->m_focus = m_displayTreeFlat[m_selectionIndex]->node;
+        m_systemView->focus() = m_displayTreeFlat[m_selectionIndex]->node;
         finish();
     }else
     {
-        if(key < 0) return;
+        //Arrows, mouse reports and other extended codes are not text
+        if(key < 0 || key >= input::CTRL_RANGE_START) return;
         switch(key) {
             case 127:
             case '\b': {
@@ -484,7 +794,5 @@ SystemView::Search::draw()
     searchWindow << "Query: " << m_query << '\n';
     
     drawNode(m_displayTree, searchWindow, 0);
-
-    searchWindow << straw::flush();
     m_dirty = false;
 }
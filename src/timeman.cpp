@@ -43,7 +43,8 @@ TimeMan::draw()
     Window &timeWindow = context[WINDOW_TIMEMAN_ID];
     timeWindow << straw::clear(' ');
 
-    timeWindow << straw::move(0, 0) << straw::resetcolor() << m_time.format("%S %D, %C \n%H:%m\n\n");
-    timeWindow << m_step.format("Step:\n%Y Years, %M Months\n%D Days, %H Hours\n%m Minutes, %s Seconds\n\n");
+    timeWindow << straw::move(0, 0) << straw::resetcolor();
+    m_time.format(timeWindow, "%S %D, %C \n%H:%m\n\n");
+    m_step.format(timeWindow, "Step:\n%Y Years, %M Months\n%D Days, %H Hours\n%m Minutes, %s Seconds\n\n");
     if(m_auto) timeWindow << "Auto";
 }
@@ -1,6 +1,9 @@
 #include "window.hpp"
 #include "keybind.hpp"
 
+#include <algorithm>
+#include <cassert>
+
 void 
 Window::draw(bool focus)
 {
@@ -10,8 +13,6 @@ Window::draw(bool focus)
     }else{
         m_border << straw::setcolor(straw::WHITE, straw::BLACK) << straw::clear(' ') << straw::move(0, 0) << m_title;
     }
-    m_border.flush();
-    m_screen.flush();
 }
 
 void 
@@ -21,8 +22,92 @@ WindowContext::registerWindow(const std::string &id,
                         unsigned w, unsigned h,
                         bool hidden)
 {
+    assert(m_windowOrder.size() < NO_OWNER);
     m_windows.emplace(id, Window(title, x, y, w, h, hidden));
     m_windowOrder.push_back(id);
+    restack();
+}
+
+/*Copies what changed on canvas into the framebuffer, skipping cells covered by another window*/
+void
+WindowContext::compose(std::uint8_t index, straw::screen<screenchr> &canvas)
+{
+    unsigned frameW = m_frame.getwidth();
+    unsigned frameH = m_frame.getheight();
+    unsigned cx = canvas.getx();
+    unsigned cy = canvas.gety();
+    if(int n = canvas.takescroll(); n != 0) {
+        if((unsigned)std::abs(n) < canvas.getheight() && owns(index, cx, cy, cx + canvas.getwidth(), cy + canvas.getheight()) &&
+                straw::term.canscroll(cx, cx + canvas.getwidth())) {
+            m_frame.scroll(straw::region{cx, cy, cx + canvas.getwidth(), cy + canvas.getheight()}, n);
+        }else{
+            canvas.touchall();
+        }
+    }
+    canvas.drain([&](unsigned y, unsigned x0, unsigned x1) {
+        if(cy + y >= frameH || cx >= frameW) return;
+        x1 = std::min(x1, frameW - cx);
+        const std::uint8_t *owner = m_owner.data() + ((cy + y) * frameW) + cx;
+        const straw::cell<screenchr> *row = canvas.row(y);
+        for(unsigned x = x0; x < x1;) {
+            while(x < x1 && owner[x] != index) x++;
+            unsigned run = x;
+            while(run < x1 && owner[run] == index) run++;
+            if(run > x) m_frame.blit(cx + x, cy + y, row + x, run - x);
+            x = run;
+        }
+    });
+}
+
+/*True when window index shows every cell of [x0, x1) x [y0, y1)*/
+bool
+WindowContext::owns(std::uint8_t index, unsigned x0, unsigned y0, unsigned x1, unsigned y1) const
+{
+    unsigned frameW = m_frame.getwidth();
+    if(x1 > frameW || y1 > m_frame.getheight()) return false;
+    for(unsigned y = y0; y < y1; y++) {
+        const std::uint8_t *owner = m_owner.data() + (y * frameW);
+        if(std::any_of(owner + x0, owner + x1, [index](std::uint8_t o) { return o != index; })) return false;
+    }
+    return true;
+}
+
+std::string
+WindowContext::windowAt(unsigned x, unsigned y) const
+{
+    unsigned frameW = m_frame.getwidth();
+    if(x >= frameW || y >= m_frame.getheight()) return std::string();
+    std::uint8_t index = m_owner[(y * frameW) + x];
+    return index == NO_OWNER ? std::string() : m_windowOrder[index];
+}
+
+/*Reassigns cells to the topmost visible window and repaints only those that changed hands*/
+void
+WindowContext::restack()
+{
+    unsigned frameW = m_frame.getwidth();
+    unsigned frameH = m_frame.getheight();
+    std::vector<std::uint8_t> owner(m_owner.size(), NO_OWNER);
+    for(unsigned i = 0; i < m_windowOrder.size(); i++) {
+        Window &window = m_windows.at(m_windowOrder[i]);
+        if(window.hidden()) continue;
+        unsigned x1 = std::min(window.getx() + window.getwidth(), frameW);
+        unsigned y1 = std::min(window.gety() + window.getheight(), frameH);
+        for(unsigned y = window.gety(); y < y1; y++) {
+            for(unsigned x = window.getx(); x < x1; x++) owner[(y * frameW) + x] = (std::uint8_t)i;
+        }
+    }
+
+    const straw::cell<screenchr> blank{' '};
+    for(unsigned y = 0; y < frameH; y++) {
+        for(unsigned x = 0; x < frameW; x++) {
+            std::uint8_t index = owner[(y * frameW) + x];
+            if(index == m_owner[(y * frameW) + x]) continue;
+            const straw::cell<screenchr> &c = index == NO_OWNER ? blank : m_windows.at(m_windowOrder[index]).at(x, y);
+            m_frame.blit(x, y, &c, 1);
+        }
+    }
+    m_owner.swap(owner);
 }
 
 void
@@ -45,9 +130,69 @@ WindowContext::update(int code)
 void
 WindowContext::draw()
 {
-    for(unsigned i = 0; i < m_windows.size(); i++) {
-        m_windows.at(m_windowOrder[i]).draw(i == m_focus);
+    for(unsigned i = 0; i < m_windowOrder.size(); i++) {
+        Window &window = m_windows.at(m_windowOrder[i]);
+        window.draw(i == m_focus);
+        if(window.hidden()) {
+            //Shown again through restack, which copies everything the window covers
+            window.border()->drain([](unsigned, unsigned, unsigned) {});
+            window.screen()->drain([](unsigned, unsigned, unsigned) {});
+            window.screen()->takescroll();
+            continue;
+        }
+        compose((std::uint8_t)i, *window.border());
+        compose((std::uint8_t)i, *window.screen());
+    }
+    //While the writer is behind the framebuffer keeps collecting changes
+    if(!straw::term.ready()) return;
+    if(straw::term.framebudget() == 0) {
+        m_frame.flush();
+        return;
     }
+    prioritize();
+    //Frames cut short in a row hand the lead to each region in turn, so nothing waits forever
+    if(m_deferred >= DEFER_FRAMES && !m_priorities.empty()) {
+        std::size_t lead = (m_deferred / DEFER_FRAMES) % m_priorities.size();
+        std::rotate(m_priorities.begin(), m_priorities.begin() + (long)lead, m_priorities.end());
+    }
+    m_deferred = m_frame.flush(m_priorities, straw::term.framebudget()) ? 0 : m_deferred + 1;
+}
+
+/*Order cells go out in when the frame budget runs short: every window's
+ * hotspot, windows smaller than the focused one smallest first, so text
+ * panels are never held up by a busy view, then the focused window and the
+ * rest*/
+void
+WindowContext::prioritize()
+{
+    m_priorities.clear();
+    auto bounds = [](Window &window) {
+        return straw::region{window.getx(), window.gety(), window.getx() + window.getwidth(), window.gety() + window.getheight()};
+    };
+    auto area = [](Window *window) { return window->getwidth() * window->getheight(); };
+    std::vector<Window *> shown;
+    Window *focused = nullptr;
+    for(unsigned i = 0; i < m_windowOrder.size(); i++) {
+        Window &window = m_windows.at(m_windowOrder[i]);
+        if(window.hidden()) continue;
+        if(i == m_focus) focused = &window;
+        else shown.push_back(&window);
+    }
+    for(const std::string &id : m_windowOrder) {
+        Window &window = m_windows.at(id);
+        straw::region hot = window.hotspot();
+        if(!window.hidden() && hot.y0 < hot.y1) m_priorities.push_back(hot);
+    }
+    std::stable_sort(shown.begin(), shown.end(), [&area](Window *a, Window *b) { return area(a) < area(b); });
+    bool placed = focused == nullptr;
+    for(Window *window : shown) {
+        if(!placed && area(window) >= area(focused)) {
+            m_priorities.push_back(bounds(*focused));
+            placed = true;
+        }
+        m_priorities.push_back(bounds(*window));
+    }
+    if(!placed) m_priorities.push_back(bounds(*focused));
 }
 
 void 
@@ -64,9 +209,8 @@ WindowContext::focus(const std::string &id)
 void
 WindowContext::setWindowHidden(const std::string &id, bool mode)
 {
-    m_windows.at(id).setHidden(mode);
-    for(unsigned i = 0; i < m_windows.size(); i++) {
-        if(m_windowOrder[i] == id && mode) continue; 
-        m_windows.at(m_windowOrder[i]) << straw::redraw();
-    }
+    Window &window = m_windows.at(id);
+    if(window.hidden() == mode) return;
+    window.setHidden(mode);
+    restack();
 }
@@ -0,0 +1,51 @@
+#include "workers.hpp"
+
+#include <algorithm>
+
+namespace workers {
+
+Pool::Pool(unsigned count) :
+    m_count(count)
+{
+}
+
+Pool::Pool() :
+    Pool(std::max(std::thread::hardware_concurrency(), 1u) - 1)
+{
+}
+
+Pool::~Pool()
+{
+    {
+        std::lock_guard lock(m_lock);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for(std::thread &thread : m_threads) thread.join();
+}
+
+void
+Pool::work()
+{
+    s_working = true;
+    for(std::size_t i = m_next++; i < m_size; i = m_next++) m_job(i);
+    s_working = false;
+}
+
+void
+Pool::loop()
+{
+    unsigned long seen = 0;
+    std::unique_lock lock(m_lock);
+    for(;;) {
+        m_wake.wait(lock, [this, seen]() { return m_stopping || m_generation != seen; });
+        if(m_stopping) return;
+        seen = m_generation;
+        lock.unlock();
+        work();
+        lock.lock();
+        if(--m_active == 0) m_done.notify_one();
+    }
+}
+
+}